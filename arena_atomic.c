@@ -0,0 +1,393 @@
+/*
+============================================================
+ arena_atomic.c — concurrent bump arena + scaling benchmark (C11)
+============================================================
+
+This file implements:
+- AtomicArena: a thread-safe arena on top of the C89 core, where
+  allocation is one atomic fetch-add on the cursor
+- ArenaGroup: per-thread chunks leased from one AtomicArena, so the
+  common case is a plain bump with no shared cache line at all
+- A multi-threaded benchmark comparing them with a mutex-wrapped
+  Arena at 1..BENCH_MAX_THREADS threads
+
+The committed range is still owned by an ordinary Arena. Its cursor
+marks the highest end any thread has asked to be committed, so all
+commit growth goes through arena_alloc and the core's os_commit.
+============================================================
+*/
+
+/* =========================================================
+ * Feature test macros
+ * ========================================================= */
+
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+    #define _DEFAULT_SOURCE 1
+#endif
+
+/* =========================================================
+ * Headers
+ * ========================================================= */
+
+#include <stddef.h>     /* size_t */
+#include <stdatomic.h>  /* atomic_* */
+
+#include "giga/arena_atomic.h"
+
+/* =========================================================
+ * AtomicArena API
+ * ========================================================= */
+
+int atomic_arena_init(AtomicArena *c, const ArenaConfig *cfg)
+{
+    ArenaConfig single = *cfg;
+
+    /*
+     Offsets are relative to one base: no block chaining, and commit
+     growth through the inner arena must never take the large path.
+    */
+    single.flags &= ~ARENA_CHAINED;
+    single.large_threshold = 0;
+
+    if (!arena_init_ex(&c->arena, &single))
+        return 0;
+
+    atomic_init(&c->cursor, 0);
+    atomic_init(&c->commit, (size_t)(c->arena.commit - c->arena.base));
+    atomic_flag_clear(&c->lock);
+
+    return 1;
+}
+
+void atomic_arena_destroy(AtomicArena *c)
+{
+    arena_destroy(&c->arena);
+}
+
+/*
+ Point the inner arena's cursor at what threads actually claimed, so
+ arena_reset records a true high-water mark.
+*/
+static void atomic_arena_sync(AtomicArena *c)
+{
+    size_t used = atomic_load_explicit(&c->cursor, memory_order_relaxed);
+
+    if (used > c->arena.reserve_size)
+        used = c->arena.reserve_size;
+
+    c->arena.cursor = c->arena.base + used;
+}
+
+void atomic_arena_reset(AtomicArena *c)
+{
+    atomic_arena_sync(c);
+    arena_reset(&c->arena);
+    atomic_store_explicit(&c->cursor, 0, memory_order_relaxed);
+}
+
+void atomic_arena_reset_decommit(AtomicArena *c, size_t retain)
+{
+    atomic_arena_sync(c);
+    arena_reset_decommit(&c->arena, retain);
+    atomic_store_explicit(&c->cursor, 0, memory_order_relaxed);
+    atomic_store_explicit(&c->commit,
+                          (size_t)(c->arena.commit - c->arena.base),
+                          memory_order_relaxed);
+}
+
+/*
+ [off, end) is already ours (the fetch-add claimed it) but not yet
+ known to be committed. One thread at a time grows the inner arena
+ up to `end`; the rest spin briefly and then find it committed.
+*/
+void *atomic_arena_alloc_slow(AtomicArena *c, size_t off, size_t end)
+{
+    Arena *a = &c->arena;
+    void *result = a->base + off;
+
+    if (end < off || end > a->reserve_size)
+        return NULL;
+
+    while (atomic_flag_test_and_set_explicit(&c->lock,
+                                             memory_order_acquire))
+        ; /* held for one os_commit at most */
+
+    if (end > atomic_load_explicit(&c->commit, memory_order_relaxed)) {
+        size_t used = (size_t)(a->cursor - a->base);
+
+        if (!arena_alloc(a, end - used)) {
+            result = NULL;
+        } else {
+            atomic_store_explicit(&c->commit,
+                                  (size_t)(a->commit - a->base),
+                                  memory_order_release);
+        }
+    }
+
+    atomic_flag_clear_explicit(&c->lock, memory_order_release);
+    return result;
+}
+
+/* =========================================================
+ * ArenaGroup API
+ * ========================================================= */
+
+static void group_lock(ArenaGroup *g)
+{
+    while (atomic_flag_test_and_set_explicit(&g->lock,
+                                             memory_order_acquire))
+        ; /* held for a list splice */
+}
+
+static void group_unlock(ArenaGroup *g)
+{
+    atomic_flag_clear_explicit(&g->lock, memory_order_release);
+}
+
+int arena_group_init(ArenaGroup *g, const ArenaConfig *cfg,
+                     size_t chunk_min, size_t chunk_max)
+{
+    if (!atomic_arena_init(&g->shared, cfg))
+        return 0;
+
+    chunk_min = (chunk_min + (g->shared.arena.alignment - 1))
+              & ~(g->shared.arena.alignment - 1);
+    if (chunk_max < chunk_min)
+        chunk_max = chunk_min;
+
+    g->chunk_min = chunk_min;
+    g->chunk_max = chunk_max;
+    g->locals    = NULL;
+    atomic_flag_clear(&g->lock);
+
+    return 1;
+}
+
+void arena_group_destroy(ArenaGroup *g)
+{
+    atomic_arena_destroy(&g->shared);
+}
+
+void arena_local_attach(ArenaGroup *g, ArenaLocal *l)
+{
+    l->cursor     = NULL;
+    l->end        = NULL;
+    l->chunk_size = g->chunk_min;
+
+    group_lock(g);
+    l->next   = g->locals;
+    g->locals = l;
+    group_unlock(g);
+}
+
+/* The unused tail of the local's chunk is reclaimed at the next reset */
+void arena_local_detach(ArenaGroup *g, ArenaLocal *l)
+{
+    ArenaLocal **link;
+
+    group_lock(g);
+    for (link = &g->locals; *link; link = &(*link)->next) {
+        if (*link == l) {
+            *link = l->next;
+            break;
+        }
+    }
+    group_unlock(g);
+
+    l->cursor = NULL;
+    l->end    = NULL;
+}
+
+void arena_group_reset(ArenaGroup *g)
+{
+    ArenaLocal *l;
+
+    for (l = g->locals; l; l = l->next) {
+        l->cursor     = NULL;
+        l->end        = NULL;
+        l->chunk_size = g->chunk_min;
+    }
+
+    atomic_arena_reset(&g->shared);
+}
+
+/*
+ Current chunk is full: lease the next one (geometrically larger, so
+ a busy thread touches the shared cursor less and less), or hand big
+ requests straight to the shared arena.
+*/
+void *arena_local_alloc_slow(ArenaGroup *g, ArenaLocal *l, size_t size)
+{
+    size_t lease;
+    unsigned char *chunk;
+
+    /* Zero bytes fit anywhere in a chunk; lease one only if there is none */
+    if (size == 0 && l->cursor)
+        return l->cursor;
+
+    if (size > g->chunk_max / 2)
+        return atomic_arena_alloc(&g->shared, size);
+
+    lease = l->chunk_size;
+    if (lease < size)
+        lease = size;
+
+    chunk = (unsigned char *)atomic_arena_alloc(&g->shared, lease);
+    if (!chunk)
+        return NULL;
+
+    if (l->chunk_size < g->chunk_max) {
+        l->chunk_size *= 2;
+        if (l->chunk_size > g->chunk_max)
+            l->chunk_size = g->chunk_max;
+    }
+
+    l->cursor = chunk + size;
+    l->end    = chunk + lease;
+    return chunk;
+}
+
+/* =========================================================
+ * Benchmark
+ * ========================================================= */
+
+#ifndef GIGA_ARENA_NO_MAIN
+
+#include <stdio.h>      /* printf */
+#include <pthread.h>    /* pthread_create, pthread_mutex_t */
+#include <time.h>       /* clock_gettime */
+
+/* Benchmark parameters */
+#define BENCH_ALLOC_SIZE  64
+#define BENCH_ITERATIONS  10000000UL
+#define BENCH_MAX_THREADS 8
+
+/* ArenaGroup lease sizes */
+#define BENCH_CHUNK_MIN (64UL * 1024)
+#define BENCH_CHUNK_MAX (2UL * 1024 * 1024)
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void *volatile arena_sink;
+
+typedef struct BenchShared {
+    Arena arena;
+    pthread_mutex_t mutex;
+    AtomicArena atomic;
+    ArenaGroup group;
+    size_t per_thread;
+} BenchShared;
+
+static void *bench_mutex_worker(void *arg)
+{
+    BenchShared *s = (BenchShared *)arg;
+    size_t i;
+
+    for (i = 0; i < s->per_thread; ++i) {
+        pthread_mutex_lock(&s->mutex);
+        arena_sink = arena_alloc(&s->arena, BENCH_ALLOC_SIZE);
+        pthread_mutex_unlock(&s->mutex);
+    }
+    return NULL;
+}
+
+static void *bench_atomic_worker(void *arg)
+{
+    BenchShared *s = (BenchShared *)arg;
+    size_t i;
+
+    for (i = 0; i < s->per_thread; ++i)
+        arena_sink = atomic_arena_alloc(&s->atomic, BENCH_ALLOC_SIZE);
+    return NULL;
+}
+
+static void *bench_group_worker(void *arg)
+{
+    BenchShared *s = (BenchShared *)arg;
+    ArenaLocal local;
+    size_t i;
+
+    arena_local_attach(&s->group, &local);
+    for (i = 0; i < s->per_thread; ++i)
+        arena_sink = arena_local_alloc(&s->group, &local, BENCH_ALLOC_SIZE);
+    arena_local_detach(&s->group, &local);
+
+    return NULL;
+}
+
+/* Run `worker` on `threads` threads sharing BENCH_ITERATIONS allocations */
+static double bench_run(BenchShared *s, void *(*worker)(void *),
+                        int threads)
+{
+    pthread_t tid[BENCH_MAX_THREADS];
+    double t0, t1;
+    int i;
+
+    s->per_thread = BENCH_ITERATIONS / (size_t)threads;
+
+    t0 = now_seconds();
+    for (i = 0; i < threads; ++i)
+        pthread_create(&tid[i], NULL, worker, s);
+    for (i = 0; i < threads; ++i)
+        pthread_join(tid[i], NULL);
+    t1 = now_seconds();
+
+    return (double)(s->per_thread * (size_t)threads) / (t1 - t0);
+}
+
+int main(void)
+{
+    static BenchShared s;
+    ArenaConfig cfg;
+    int threads;
+
+    arena_config_init(&cfg, 1024UL * 1024 * 1024, 64UL * 1024);
+
+    if (!arena_init_ex(&s.arena, &cfg) ||
+        !atomic_arena_init(&s.atomic, &cfg) ||
+        !arena_group_init(&s.group, &cfg,
+                          BENCH_CHUNK_MIN, BENCH_CHUNK_MAX)) {
+        printf("arena init failed\n");
+        return 1;
+    }
+    pthread_mutex_init(&s.mutex, NULL);
+
+    printf("============================================\n");
+    printf(" Concurrent Arena Scaling Benchmark (C11)\n");
+    printf("============================================\n");
+    printf("alloc size : %d bytes\n", BENCH_ALLOC_SIZE);
+    printf("iterations : %lu (split across threads)\n\n",
+           (unsigned long)BENCH_ITERATIONS);
+    printf("threads   mutex+Arena alloc/s   AtomicArena alloc/s"
+           "    ArenaGroup alloc/s\n");
+
+    for (threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2) {
+        double locked, atomic, group;
+
+        locked = bench_run(&s, bench_mutex_worker, threads);
+        arena_reset(&s.arena);
+
+        atomic = bench_run(&s, bench_atomic_worker, threads);
+        atomic_arena_reset(&s.atomic);
+
+        group = bench_run(&s, bench_group_worker, threads);
+        arena_group_reset(&s.group);
+
+        printf("%7d   %19.0f   %19.0f   %19.0f\n",
+               threads, locked, atomic, group);
+    }
+
+    pthread_mutex_destroy(&s.mutex);
+    arena_group_destroy(&s.group);
+    atomic_arena_destroy(&s.atomic);
+    arena_destroy(&s.arena);
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,486 @@
+/*
+============================================================
+ arena_percpu.c — per-CPU sharded arenas + scaling benchmark (C11)
+============================================================
+
+This file implements:
+- ArenaPercpu: one bump chunk per CPU, leased from an AtomicArena,
+  bumped inside an rseq critical section (x86-64 Linux) or with
+  getcpu + compare-exchange everywhere else
+- A benchmark comparing it with AtomicArena and ArenaGroup for
+  throughput and for memory leased but unused, up to far more threads
+  than CPUs
+
+A shard only ever changes its chunk pointer with a single store. A
+refill builds the new chunk privately and then publishes it; a bump
+racing with that finishes in the old chunk, which is simply
+abandoned. Allocations already made from it stay valid.
+============================================================
+*/
+
+/* =========================================================
+ * Feature test macros
+ * ========================================================= */
+
+/* sched_getcpu and the rseq exports are GNU extensions */
+#if !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE 1
+#endif
+
+/* =========================================================
+ * Headers
+ * ========================================================= */
+
+#include <stddef.h>     /* size_t */
+#include <stdint.h>     /* uintptr_t */
+#include <stdatomic.h>  /* atomic_* */
+#include <unistd.h>     /* sysconf */
+
+#if defined(__linux__)
+    #include <sched.h>  /* sched_getcpu */
+#endif
+
+#include "giga/arena_percpu.h"
+
+/*
+ rseq fast path: x86-64 only (hand-written critical section), and
+ glibc 2.35+, which registers every thread and exports where its
+ struct rseq lives.
+*/
+#if defined(__linux__) && defined(__x86_64__) && defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+    #include <sys/rseq.h>   /* __rseq_offset, __rseq_size */
+    #define ARENA_PERCPU_RSEQ 1
+#else
+    #define ARENA_PERCPU_RSEQ 0
+#endif
+
+/* =========================================================
+ * Chunks
+ * ========================================================= */
+
+/*
+ Header at the start of every leased chunk. The rseq fast path reads
+ `cursor` at offset 0 and `end` at offset 8.
+*/
+struct ArenaPercpuChunk {
+    _Atomic uintptr_t cursor;
+    uintptr_t end;
+};
+
+/* Header space, so the first block keeps cache-line alignment */
+#define PERCPU_HEADER 64
+
+_Static_assert(sizeof(ArenaShard) == ARENA_SHARD_SIZE,
+               "rseq fast path indexes shards by cpu * 64");
+_Static_assert(sizeof(struct ArenaPercpuChunk) <= PERCPU_HEADER,
+               "chunk header must fit in PERCPU_HEADER");
+
+/* Every shard starts (and restarts after reset) on this: always full */
+static struct ArenaPercpuChunk percpu_empty;
+
+/* =========================================================
+ * CPU lookup
+ * ========================================================= */
+
+#if ARENA_PERCPU_RSEQ
+
+/* cpu_id field of this thread's struct rseq; negative if unregistered */
+static int percpu_rseq_cpu(void)
+{
+    int cpu;
+
+    __asm__ __volatile__ ("movl %%fs:4(%1), %0"
+                          : "=r" (cpu)
+                          : "r" (__rseq_offset));
+    return cpu;
+}
+
+/*
+ Bump the current CPU's chunk in one restartable sequence:
+
+   cpu = rseq->cpu_id; chunk = shards[cpu].chunk;
+   if (chunk->cursor + size > chunk->end) -> full
+   *out = chunk->cursor; chunk->cursor += size;   <- commit store
+
+ If the thread is preempted, migrated or signalled before the commit
+ store, the kernel jumps to the abort handler and nothing was written
+ to the shared state. Returns 1 on success, 0 if the chunk is full
+ (or the CPU has no shard), -1 after an abort.
+*/
+static int percpu_rseq_bump(ArenaPercpu *p, size_t size, uintptr_t *out)
+{
+    __asm__ __volatile__ goto (
+        ".pushsection __rseq_cs, \"aw\"\n\t"
+        ".balign 32\n\t"
+        "3:\n\t"
+        ".long 0x0, 0x0\n\t"                /* version, flags */
+        ".quad 1f, (2f - 1f), 4f\n\t"       /* start, length, abort */
+        ".popsection\n\t"
+        "leaq 3b(%%rip), %%rax\n\t"
+        "movq %%rax, %%fs:8(%[off])\n\t"    /* rseq->rseq_cs = &cs */
+        "1:\n\t"
+        "movl %%fs:4(%[off]), %%eax\n\t"    /* rseq->cpu_id */
+        "cmpl %[ncpu], %%eax\n\t"
+        "jae %l[full]\n\t"
+        "shlq $6, %%rax\n\t"
+        "addq %[shards], %%rax\n\t"
+        "movq (%%rax), %%rax\n\t"           /* shard->chunk */
+        "movq (%%rax), %%rcx\n\t"           /* chunk->cursor */
+        "movq %%rcx, %%rdx\n\t"
+        "addq %[size], %%rdx\n\t"
+        "jc %l[full]\n\t"
+        "cmpq 8(%%rax), %%rdx\n\t"          /* chunk->end */
+        "ja %l[full]\n\t"
+        "movq %%rcx, (%[out])\n\t"
+        "movq %%rdx, (%%rax)\n\t"           /* commit */
+        "2:\n\t"
+        ".pushsection __rseq_failure, \"ax\"\n\t"
+        ".byte 0x0f, 0xb9, 0x3d\n\t"        /* ud1 + RSEQ_SIG */
+        ".long 0x53053053\n\t"
+        "4:\n\t"
+        "jmp %l[aborted]\n\t"
+        ".popsection\n\t"
+        :
+        : [off] "r" (__rseq_offset), [ncpu] "r" (p->ncpu),
+          [shards] "r" (p->shards), [size] "r" (size), [out] "r" (out)
+        : "memory", "cc", "rax", "rcx", "rdx"
+        : full, aborted);
+    return 1;
+full:
+    return 0;
+aborted:
+    return -1;
+}
+
+#endif
+
+/* Current CPU, or -1 if it has no shard (or cannot be known) */
+static int percpu_cpu(const ArenaPercpu *p)
+{
+    int cpu = -1;
+
+#if ARENA_PERCPU_RSEQ
+    if (p->rseq)
+        cpu = percpu_rseq_cpu();
+    else
+#endif
+#if defined(__linux__)
+        cpu = sched_getcpu();
+#endif
+
+    return cpu >= 0 && (unsigned)cpu < p->ncpu ? cpu : -1;
+}
+
+/* =========================================================
+ * ArenaPercpu API
+ * ========================================================= */
+
+int arena_percpu_init(ArenaPercpu *p, const ArenaConfig *cfg,
+                      size_t chunk_size)
+{
+    long ncpu = sysconf(_SC_NPROCESSORS_CONF);
+    unsigned i;
+
+    p->ncpu = ncpu > 0 ? (unsigned)ncpu : 1;
+    p->chunk_size = (chunk_size + (PERCPU_HEADER - 1))
+                  & ~(size_t)(PERCPU_HEADER - 1);
+    if (p->chunk_size < 2 * PERCPU_HEADER)
+        p->chunk_size = 2 * PERCPU_HEADER;
+
+    if (!atomic_arena_init(&p->backing, cfg))
+        return 0;
+
+    /* Blocks start right after the header, so it caps the alignment */
+    if (p->backing.arena.alignment > PERCPU_HEADER) {
+        atomic_arena_destroy(&p->backing);
+        return 0;
+    }
+
+    if (!arena_init(&p->table, p->ncpu * sizeof(ArenaShard),
+                    p->ncpu * sizeof(ArenaShard))) {
+        atomic_arena_destroy(&p->backing);
+        return 0;
+    }
+
+    p->shards = (ArenaShard *)arena_alloc_aligned(
+        &p->table, p->ncpu * sizeof(ArenaShard), ARENA_SHARD_SIZE);
+    if (!p->shards) {
+        arena_destroy(&p->table);
+        atomic_arena_destroy(&p->backing);
+        return 0;
+    }
+
+    for (i = 0; i < p->ncpu; ++i)
+        atomic_init(&p->shards[i].chunk, &percpu_empty);
+
+#if ARENA_PERCPU_RSEQ
+    p->rseq = __rseq_size > 0 && percpu_rseq_cpu() >= 0;
+#else
+    p->rseq = 0;
+#endif
+
+    return 1;
+}
+
+void arena_percpu_destroy(ArenaPercpu *p)
+{
+    arena_destroy(&p->table);
+    atomic_arena_destroy(&p->backing);
+}
+
+/* Every shard back to the empty chunk, then rewind the backing arena */
+void arena_percpu_reset(ArenaPercpu *p)
+{
+    unsigned i;
+
+    for (i = 0; i < p->ncpu; ++i)
+        atomic_store_explicit(&p->shards[i].chunk, &percpu_empty,
+                              memory_order_relaxed);
+
+    atomic_arena_reset(&p->backing);
+}
+
+/*
+ The shard's chunk is full: lease a new one, take this request from
+ its start and publish the rest. Requests larger than half a chunk,
+ and threads without a shard, go straight to the backing arena. A
+ zero-byte request only leases when the shard has no chunk yet.
+*/
+static void *percpu_refill(ArenaPercpu *p, size_t size, int cpu)
+{
+    struct ArenaPercpuChunk *c;
+    unsigned char *chunk;
+
+    if (size == 0 && cpu >= 0) {
+        c = atomic_load_explicit(&p->shards[cpu].chunk,
+                                 memory_order_acquire);
+        if (c != &percpu_empty)
+            return (void *)atomic_load_explicit(&c->cursor,
+                                                memory_order_relaxed);
+    }
+
+    if (cpu < 0 || size > (p->chunk_size - PERCPU_HEADER) / 2)
+        return atomic_arena_alloc(&p->backing, size);
+
+    chunk = (unsigned char *)atomic_arena_alloc(&p->backing, p->chunk_size);
+    if (!chunk)
+        return NULL;
+
+    c = (struct ArenaPercpuChunk *)chunk;
+    atomic_init(&c->cursor, (uintptr_t)(chunk + PERCPU_HEADER + size));
+    c->end = (uintptr_t)(chunk + p->chunk_size);
+
+    atomic_store_explicit(&p->shards[cpu].chunk, c, memory_order_release);
+    return chunk + PERCPU_HEADER;
+}
+
+void *arena_percpu_alloc(ArenaPercpu *p, size_t size)
+{
+    struct ArenaPercpuChunk *c;
+    uintptr_t cur;
+    int cpu;
+
+    /* Never fits; rounding it could wrap to 0 */
+    if (size > p->backing.arena.reserve_size)
+        return NULL;
+
+    size = (size + (p->backing.arena.alignment - 1))
+         & ~(p->backing.arena.alignment - 1);
+
+    /*
+     The empty shard has cursor == end == 0, where zero bytes would
+     "fit" at address 0: let the refill path find a real chunk.
+    */
+    if (size == 0)
+        return percpu_refill(p, 0, percpu_cpu(p));
+
+#if ARENA_PERCPU_RSEQ
+    if (p->rseq) {
+        uintptr_t result;
+        int r;
+
+        while ((r = percpu_rseq_bump(p, size, &result)) < 0)
+            ; /* aborted: preempted or migrated, try on the new CPU */
+        if (r)
+            return (void *)result;
+
+        return percpu_refill(p, size, percpu_cpu(p));
+    }
+#endif
+
+    cpu = percpu_cpu(p);
+    if (cpu < 0)
+        return percpu_refill(p, size, cpu);
+
+    /* getcpu fallback: the thread may migrate, so the bump is a CAS */
+    c = atomic_load_explicit(&p->shards[cpu].chunk, memory_order_acquire);
+    cur = atomic_load_explicit(&c->cursor, memory_order_relaxed);
+    do {
+        if (size > c->end - cur)
+            return percpu_refill(p, size, cpu);
+    } while (!atomic_compare_exchange_weak_explicit(
+                 &c->cursor, &cur, cur + size,
+                 memory_order_relaxed, memory_order_relaxed));
+
+    return (void *)cur;
+}
+
+/* =========================================================
+ * Benchmark
+ * ========================================================= */
+
+#ifndef GIGA_ARENA_NO_MAIN
+
+#include <stdio.h>      /* printf */
+#include <pthread.h>    /* pthread_create */
+#include <time.h>       /* clock_gettime */
+
+/* Benchmark parameters */
+#define BENCH_ALLOC_SIZE  64
+#define BENCH_ITERATIONS  10000000UL
+#define BENCH_MAX_THREADS 256
+
+/* Lease sizes: per-CPU chunk, and ArenaGroup's per-thread range */
+#define BENCH_CHUNK       (256UL * 1024)
+#define BENCH_CHUNK_MIN   (64UL * 1024)
+#define BENCH_CHUNK_MAX   (2UL * 1024 * 1024)
+
+static const int bench_threads[] = { 1, 2, 4, 8, 64, 256 };
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void *volatile arena_sink;
+
+typedef struct BenchShared {
+    AtomicArena atomic;
+    ArenaGroup group;
+    ArenaPercpu percpu;
+    size_t per_thread;
+} BenchShared;
+
+static void *bench_atomic_worker(void *arg)
+{
+    BenchShared *s = (BenchShared *)arg;
+    size_t i;
+
+    for (i = 0; i < s->per_thread; ++i)
+        arena_sink = atomic_arena_alloc(&s->atomic, BENCH_ALLOC_SIZE);
+    return NULL;
+}
+
+static void *bench_group_worker(void *arg)
+{
+    BenchShared *s = (BenchShared *)arg;
+    ArenaLocal local;
+    size_t i;
+
+    arena_local_attach(&s->group, &local);
+    for (i = 0; i < s->per_thread; ++i)
+        arena_sink = arena_local_alloc(&s->group, &local, BENCH_ALLOC_SIZE);
+    arena_local_detach(&s->group, &local);
+
+    return NULL;
+}
+
+static void *bench_percpu_worker(void *arg)
+{
+    BenchShared *s = (BenchShared *)arg;
+    size_t i;
+
+    for (i = 0; i < s->per_thread; ++i)
+        arena_sink = arena_percpu_alloc(&s->percpu, BENCH_ALLOC_SIZE);
+    return NULL;
+}
+
+/* Run `worker` on `threads` threads sharing BENCH_ITERATIONS allocations */
+static double bench_run(BenchShared *s, void *(*worker)(void *),
+                        int threads)
+{
+    static pthread_t tid[BENCH_MAX_THREADS];
+    double t0, t1;
+    int i;
+
+    s->per_thread = BENCH_ITERATIONS / (size_t)threads;
+
+    t0 = now_seconds();
+    for (i = 0; i < threads; ++i)
+        pthread_create(&tid[i], NULL, worker, s);
+    for (i = 0; i < threads; ++i)
+        pthread_join(tid[i], NULL);
+    t1 = now_seconds();
+
+    return (double)(s->per_thread * (size_t)threads) / (t1 - t0);
+}
+
+/* KiB leased from `c` beyond what the threads actually allocated */
+static unsigned long bench_slack_kib(const BenchShared *s, AtomicArena *c,
+                                     int threads)
+{
+    size_t leased = atomic_load_explicit(&c->cursor, memory_order_relaxed);
+    size_t used = s->per_thread * (size_t)threads * BENCH_ALLOC_SIZE;
+
+    return leased > used ? (unsigned long)((leased - used) / 1024) : 0;
+}
+
+int main(void)
+{
+    static BenchShared s;
+    ArenaConfig cfg;
+    size_t t;
+
+    arena_config_init(&cfg, 4096UL * 1024 * 1024, 64UL * 1024);
+    cfg.flags = ARENA_OVERCOMMIT;
+
+    if (!atomic_arena_init(&s.atomic, &cfg) ||
+        !arena_group_init(&s.group, &cfg, BENCH_CHUNK_MIN, BENCH_CHUNK_MAX) ||
+        !arena_percpu_init(&s.percpu, &cfg, BENCH_CHUNK)) {
+        printf("arena init failed\n");
+        return 1;
+    }
+
+    printf("============================================\n");
+    printf(" Per-CPU Arena Scaling Benchmark (C11)\n");
+    printf("============================================\n");
+    printf("alloc size : %d bytes\n", BENCH_ALLOC_SIZE);
+    printf("iterations : %lu (split across threads)\n",
+           (unsigned long)BENCH_ITERATIONS);
+    printf("cpus       : %u\n", s.percpu.ncpu);
+    printf("percpu     : %s\n\n",
+           s.percpu.rseq ? "rseq" : "getcpu + compare-exchange");
+    printf("threads   AtomicArena alloc/s   ArenaGroup alloc/s (slack KiB)"
+           "   ArenaPercpu alloc/s (slack KiB)\n");
+
+    for (t = 0; t < sizeof(bench_threads) / sizeof(bench_threads[0]); ++t) {
+        int threads = bench_threads[t];
+        double atomic, group, percpu;
+        unsigned long group_slack, percpu_slack;
+
+        atomic = bench_run(&s, bench_atomic_worker, threads);
+        atomic_arena_reset(&s.atomic);
+
+        group = bench_run(&s, bench_group_worker, threads);
+        group_slack = bench_slack_kib(&s, &s.group.shared, threads);
+        arena_group_reset(&s.group);
+
+        percpu = bench_run(&s, bench_percpu_worker, threads);
+        percpu_slack = bench_slack_kib(&s, &s.percpu.backing, threads);
+        arena_percpu_reset(&s.percpu);
+
+        printf("%7d   %19.0f   %18.0f %13lu   %19.0f %13lu\n",
+               threads, atomic, group, group_slack, percpu, percpu_slack);
+    }
+
+    arena_percpu_destroy(&s.percpu);
+    arena_group_destroy(&s.group);
+    atomic_arena_destroy(&s.atomic);
+
+    return 0;
+}
+
+#endif
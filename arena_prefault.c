@@ -0,0 +1,365 @@
+/*
+============================================================
+ arena_prefault.c — background prefaulter + latency benchmark (C11)
+============================================================
+
+This file implements:
+- ArenaPrefault: a helper thread that commits and touches pages ahead
+  of an arena's cursor, so the allocating thread neither calls
+  mprotect nor takes first-touch page faults in steady state
+- A latency benchmark that prints a per-allocation histogram and the
+  tail percentiles with and without the helper
+
+Ownership is split at `ready`: pages below it belong to the arena
+owner, pages above it to the helper until it publishes them. The
+owner only ever raises a->commit to a published `ready`, so the two
+threads never touch the same page at the same time.
+============================================================
+*/
+
+/* =========================================================
+ * Feature test macros
+ * ========================================================= */
+
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+    #define _DEFAULT_SOURCE 1
+#endif
+
+/* =========================================================
+ * Headers
+ * ========================================================= */
+
+#include <stddef.h>     /* size_t */
+#include <stdatomic.h>  /* atomic_* */
+#include <pthread.h>    /* pthread_create, pthread_join */
+#include <sched.h>      /* sched_yield */
+#include <time.h>       /* nanosleep */
+#include <unistd.h>     /* sysconf */
+#include <sys/mman.h>   /* mprotect */
+
+#include "giga/arena_prefault.h"
+
+/* =========================================================
+ * Configuration
+ * ========================================================= */
+
+/* Helper sleep when it is `headroom` ahead of the owner */
+#define PREFAULT_POLL_NS 50000L
+
+/* =========================================================
+ * Helper thread
+ * ========================================================= */
+
+static void prefault_sleep(void)
+{
+    struct timespec ts;
+
+    ts.tv_sec  = 0;
+    ts.tv_nsec = PREFAULT_POLL_NS;
+    nanosleep(&ts, NULL);
+}
+
+/*
+ Commit one chunk above `ready`, write a zero into every page of it
+ (fresh pages are zero, so the arena's dirty mark stays valid), then
+ publish it with a release store.
+*/
+static void *prefault_main(void *arg)
+{
+    ArenaPrefault *pf = (ArenaPrefault *)arg;
+    Arena *a = pf->arena;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    while (atomic_load_explicit(&pf->running, memory_order_relaxed)) {
+        size_t ready = atomic_load_explicit(&pf->ready, memory_order_relaxed);
+        size_t want = atomic_load_explicit(&pf->wanted, memory_order_relaxed);
+        size_t step, off;
+
+        if (ready >= want) {
+            prefault_sleep();
+            continue;
+        }
+
+        step = a->reserve_size - ready;
+        if (step > pf->chunk)
+            step = pf->chunk;
+
+        if (mprotect(a->base + ready, step, PROT_READ | PROT_WRITE) != 0) {
+            atomic_store_explicit(&pf->failed, 1, memory_order_release);
+            break;
+        }
+
+        for (off = 0; off < step; off += page)
+            ((volatile unsigned char *)a->base)[ready + off] = 0;
+
+        atomic_store_explicit(&pf->ready, ready + step, memory_order_release);
+    }
+
+    return NULL;
+}
+
+/* =========================================================
+ * ArenaPrefault API
+ * ========================================================= */
+
+/*
+ Start keeping `headroom` bytes (rounded to the arena's commit step)
+ committed and faulted in past the cursor of `a`.
+*/
+int arena_prefault_start(ArenaPrefault *pf, Arena *a, size_t headroom)
+{
+    size_t used, want;
+
+    if (a->flags & (ARENA_OVERCOMMIT | ARENA_CHAINED))
+        return 0;
+
+    pf->arena    = a;
+    pf->chunk    = a->commit_min;
+    pf->headroom = (headroom + pf->chunk - 1) / pf->chunk * pf->chunk;
+    pf->refills  = 0;
+    pf->stalls   = 0;
+
+    used = (size_t)(a->cursor - a->base);
+    want = used + pf->headroom;
+    if (want > a->reserve_size || want < used)
+        want = a->reserve_size;
+
+    atomic_init(&pf->ready, (size_t)(a->commit - a->base));
+    atomic_init(&pf->wanted, want);
+    atomic_init(&pf->running, 1);
+    atomic_init(&pf->failed, 0);
+
+    return pthread_create(&pf->thread, NULL, prefault_main, pf) == 0;
+}
+
+/* Join the helper; the arena keeps everything it committed */
+void arena_prefault_stop(ArenaPrefault *pf)
+{
+    Arena *a = pf->arena;
+
+    atomic_store_explicit(&pf->running, 0, memory_order_relaxed);
+    pthread_join(pf->thread, NULL);
+
+    /* Hand pages published after the last refill back to the arena */
+    a->commit = a->base + atomic_load_explicit(&pf->ready,
+                                               memory_order_acquire);
+}
+
+/*
+ The owner reached `commit`: ask for headroom past the new end and
+ take one more chunk of what the helper has published. Taking a chunk
+ at a time keeps `wanted` moving, so the helper stays `headroom` ahead
+ instead of refilling in bursts. If the helper is behind, the owner
+ yields until it catches up (a stall); it never commits by itself,
+ since the helper may already be touching those pages.
+*/
+void *arena_prefault_alloc_slow(ArenaPrefault *pf, size_t size)
+{
+    Arena *a = pf->arena;
+    size_t used = (size_t)(a->cursor - a->base);
+    size_t end, want, ready, take;
+    unsigned char *p;
+
+    if (size > a->large_threshold)
+        return arena_alloc_large(a, size, a->alignment);
+
+    if (size > a->reserve_size - used)
+        return NULL;
+
+    end  = used + size;
+    want = end + pf->headroom;
+    if (want > a->reserve_size || want < end)
+        want = a->reserve_size;
+
+    atomic_store_explicit(&pf->wanted, want, memory_order_relaxed);
+
+    ready = atomic_load_explicit(&pf->ready, memory_order_acquire);
+    if (ready < end) {
+        ++pf->stalls;
+        do {
+            if (atomic_load_explicit(&pf->failed, memory_order_acquire))
+                return NULL;
+            sched_yield();
+            ready = atomic_load_explicit(&pf->ready, memory_order_acquire);
+        } while (ready < end);
+    }
+
+    take = (end + pf->chunk) / pf->chunk * pf->chunk;
+    a->commit = a->base + (take < ready ? take : ready);
+    ++pf->refills;
+
+    p = a->cursor;
+    a->cursor = p + size;
+    return p;
+}
+
+/* =========================================================
+ * Benchmark
+ * ========================================================= */
+
+#ifndef GIGA_ARENA_NO_MAIN
+
+#include <stdio.h>      /* printf */
+#include <string.h>     /* memset */
+
+/* Benchmark parameters */
+#define LAT_ALLOC_SIZE 256
+#define LAT_ALLOCS     2000000UL
+#define LAT_HEADROOM   (8UL * 1024 * 1024)
+#define LAT_BUCKETS    32
+#define LAT_WORK       200      /* untimed work per allocation */
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void *volatile arena_sink;
+static volatile unsigned long work_sink;
+
+/* Power-of-two histogram: bucket i holds latencies in [2^i, 2^(i+1)) ns */
+typedef struct LatHist {
+    unsigned long count[LAT_BUCKETS];
+    unsigned long total;
+    double max;
+} LatHist;
+
+static void lat_record(LatHist *h, double ns)
+{
+    unsigned long v = ns < 1.0 ? 1UL : (unsigned long)ns;
+    int b = 0;
+
+    while (v > 1 && b < LAT_BUCKETS - 1) {
+        v >>= 1;
+        ++b;
+    }
+
+    ++h->count[b];
+    ++h->total;
+    if (ns > h->max)
+        h->max = ns;
+}
+
+/* Upper bound of the bucket that holds quantile q */
+static unsigned long lat_quantile(const LatHist *h, double q)
+{
+    unsigned long want = (unsigned long)((double)h->total * q);
+    unsigned long seen = 0;
+    int b;
+
+    for (b = 0; b < LAT_BUCKETS; ++b) {
+        seen += h->count[b];
+        if (seen > want)
+            return 2UL << b;
+    }
+    return 2UL << (LAT_BUCKETS - 1);
+}
+
+static void lat_print(const char *name, const LatHist *h)
+{
+    int b;
+
+    printf("%s\n", name);
+    for (b = 0; b < LAT_BUCKETS; ++b) {
+        if (h->count[b])
+            printf("  < %8lu ns : %lu\n", 2UL << b, h->count[b]);
+    }
+    printf("  p50 < %lu ns, p99 < %lu ns, p99.9 < %lu ns,"
+           " p99.99 < %lu ns, max %.0f ns\n",
+           lat_quantile(h, 0.5), lat_quantile(h, 0.99),
+           lat_quantile(h, 0.999), lat_quantile(h, 0.9999), h->max);
+}
+
+/*
+ Allocate and fill LAT_ALLOCS blocks, timing each allocation plus the
+ first write to it (where the page fault lands). LAT_WORK stands in
+ for the request handling between allocations; without it the owner
+ consumes memory faster than any helper can fault it in.
+*/
+static void bench_latency(const char *name, int prefault)
+{
+    static LatHist h;
+    Arena a;
+    ArenaPrefault pf;
+    ArenaConfig cfg;
+    size_t i;
+
+    memset(&h, 0, sizeof(h));
+
+    arena_config_init(&cfg, 1024UL * 1024 * 1024, 64UL * 1024);
+    if (!arena_init_ex(&a, &cfg)) {
+        printf("arena_init_ex failed\n");
+        return;
+    }
+
+    if (prefault) {
+        struct timespec ts;
+
+        if (!arena_prefault_start(&pf, &a, LAT_HEADROOM)) {
+            printf("arena_prefault_start failed\n");
+            arena_destroy(&a);
+            return;
+        }
+
+        /* Let the helper build its headroom, as a warm server would */
+        ts.tv_sec  = 0;
+        ts.tv_nsec = 20000000L;
+        nanosleep(&ts, NULL);
+    }
+
+    for (i = 0; i < LAT_ALLOCS; ++i) {
+        double t0, t1;
+        unsigned char *p;
+        unsigned long w;
+
+        t0 = now_ns();
+        p = prefault
+          ? (unsigned char *)arena_prefault_alloc(&pf, LAT_ALLOC_SIZE)
+          : (unsigned char *)arena_alloc(&a, LAT_ALLOC_SIZE);
+        if (!p) {
+            printf("alloc failed at %lu\n", (unsigned long)i);
+            break;
+        }
+        p[0] = (unsigned char)i;
+        t1 = now_ns();
+
+        memset(p + 1, (int)i, LAT_ALLOC_SIZE - 1);
+        arena_sink = p;
+        lat_record(&h, t1 - t0);
+
+        for (w = 0; w < LAT_WORK; ++w)
+            work_sink += w;
+    }
+
+    if (prefault)
+        arena_prefault_stop(&pf);
+
+    lat_print(name, &h);
+    if (prefault)
+        printf("  refills   : %lu (%lu stalled)\n",
+               (unsigned long)pf.refills, (unsigned long)pf.stalls);
+    else
+        printf("  commits   : %lu\n", (unsigned long)a.commit_calls);
+
+    arena_destroy(&a);
+}
+
+int main(void)
+{
+    printf("============================================\n");
+    printf(" Arena Prefault Latency Benchmark (C11)\n");
+    printf("============================================\n");
+    printf("alloc size : %d bytes (first byte written)\n", LAT_ALLOC_SIZE);
+    printf("allocations: %lu\n", (unsigned long)LAT_ALLOCS);
+    printf("headroom   : %lu KiB\n\n", (unsigned long)(LAT_HEADROOM / 1024));
+
+    bench_latency("ARENA (os_commit + first-touch faults)", 0);
+    printf("\n");
+    bench_latency("ARENA (ArenaPrefault helper thread)", 1);
+
+    return 0;
+}
+
+#endif
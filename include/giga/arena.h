@@ -3,6 +3,42 @@
 
 #include <stddef.h>
 
+/* Default allocation alignment (power of two) */
+#ifndef ARENA_ALIGNMENT
+#define ARENA_ALIGNMENT 8
+#endif
+
+/* C89 has no inline; use the compiler's spelling where there is one */
+#if defined(__GNUC__) || defined(__clang__)
+    #define GIGA_ARENA_INLINE static __inline__
+#elif defined(_MSC_VER)
+    #define GIGA_ARENA_INLINE static __inline
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
+    #define GIGA_ARENA_INLINE static inline
+#else
+    #define GIGA_ARENA_INLINE static
+#endif
+
+/* C89 has no alignof */
+#if defined(__GNUC__) || defined(__clang__)
+    #define ARENA_ALIGNOF(T) __alignof__(T)
+#elif defined(_MSC_VER)
+    #define ARENA_ALIGNOF(T) __alignof(T)
+#else
+    #define ARENA_ALIGNOF(T) offsetof(struct { char c; T t; }, t)
+#endif
+
+/* One reservation of an ARENA_CHAINED arena, parked while not current */
+typedef struct ArenaBlock {
+    unsigned char *base;    /* usable memory start */
+    unsigned char *commit;  /* committed physical limit */
+    unsigned char *limit;   /* end of reservation */
+    unsigned char *touched; /* dirty mark */
+    size_t offset;          /* bytes used in earlier blocks */
+} ArenaBlock;
+
+struct ArenaLarge;           /* header of one bypassed allocation */
+
 /* C89: unsigned char is the only guaranteed byte type */
 typedef struct Arena {
     unsigned char *base;    /* usable memory start */
@@ -11,12 +47,410 @@ typedef struct Arena {
     unsigned char *limit;   /* end of reservation */
 
     size_t reserve_size;    /* usable bytes */
-    size_t commit_step;     /* commit granularity */
+    size_t commit_step;     /* current commit granularity */
+    size_t commit_min;      /* step after init and reset */
+    size_t commit_max;      /* cap while the step doubles */
+    size_t commit_calls;    /* os_commit calls by the slow path */
+    size_t decommit_calls;  /* decommit/purge calls by resets, rewinds */
+
+    size_t high_water;      /* peak bytes in use, updated on reset */
+    size_t released;        /* total bytes decommitted by resets */
+
+    size_t page_size;       /* page size backing the reservation */
+    unsigned flags;         /* ARENA_* init flags */
+
+    unsigned char *touched; /* dirty mark: highest cursor since pages
+                               were last zeroed by the OS */
+    unsigned char *populated; /* end of the first block's range faulted
+                                 in by populate, for overcommit purges */
+
+    size_t alignment;       /* default allocation alignment */
+
+    size_t resize_in_place; /* arena_resize calls served without a copy */
+    size_t resize_copied;   /* arena_resize calls that had to copy */
+
+    ArenaBlock *blocks;     /* ARENA_CHAINED block table, else NULL */
+    size_t block_index;     /* current block; base..limit describe it */
+    size_t block_count;     /* blocks reserved so far */
+
+    size_t large_threshold; /* bigger requests get their own mapping */
+    struct ArenaLarge *large; /* live large allocations, newest first */
+    size_t large_count;     /* entries on the large list */
+    size_t large_bytes;     /* bytes mapped for them */
+
+    int numa_mode;          /* ARENA_NUMA_* in effect */
+    int numa_node;          /* node for bind/preferred, else -1 */
 } Arena;
 
+/* arena_init_ex flags */
+#define ARENA_HUGE_PAGES 0x1u  /* 2 MiB aligned base + MADV_HUGEPAGE */
+#define ARENA_HUGETLB    0x2u  /* 2 MiB pages from the hugetlb pool */
+#define ARENA_HUGETLB_1G 0x4u  /* 1 GiB pool pages, falls back to 2 MiB */
+#define ARENA_OVERCOMMIT 0x8u  /* map RW up front, kernel commits on touch */
+#define ARENA_CHAINED    0x10u /* reserve more blocks instead of failing */
+
+/* NUMA placement (ArenaConfig.numa_mode); default with one node */
+#define ARENA_NUMA_DEFAULT    0  /* first-touch placement */
+#define ARENA_NUMA_BIND       1  /* only numa_node */
+#define ARENA_NUMA_PREFERRED  2  /* numa_node, others when it is full */
+#define ARENA_NUMA_INTERLEAVE 3  /* round robin over allowed nodes */
+
+/* Savepoint returned by arena_mark */
+typedef struct ArenaMark {
+    unsigned char *cursor;
+    size_t large;           /* large allocations live at the mark */
+} ArenaMark;
+
+/* Scratch arena in use, returned by arena_scratch_begin */
+typedef struct ArenaScratch {
+    Arena *arena;           /* NULL if no arena was free */
+    ArenaMark mark;         /* rewound to by arena_scratch_end */
+} ArenaScratch;
+
+/* Fill with arena_config_init, then override fields as needed */
+typedef struct ArenaConfig {
+    size_t reserve_size;    /* usable bytes to reserve */
+    size_t commit_step;     /* initial commit granularity */
+    size_t commit_step_max; /* doubling cap; == commit_step: fixed */
+    unsigned flags;         /* ARENA_* flags */
+    size_t alignment;       /* default alignment, power of two <= page */
+    size_t large_threshold; /* 0, or map requests above it separately */
+    size_t populate;        /* bytes committed and faulted in at init */
+    int numa_mode;          /* ARENA_NUMA_* */
+    int numa_node;          /* target node for bind/preferred */
+} ArenaConfig;
+
+/*
+ Pool of ready-made arenas for short-lived owners (one per request):
+ acquire skips the mmap/mprotect/munmap of arena_init/arena_destroy.
+*/
+typedef struct ArenaCache {
+    ArenaConfig config;     /* used for every arena in the cache */
+    size_t retain;          /* bytes left committed by release */
+
+    Arena *slots;           /* capacity arenas, count initialized */
+    Arena **idle;           /* released arenas, used as a stack */
+    size_t capacity;
+    size_t count;
+    size_t idle_count;
+    size_t map_size;        /* bytes mapped for slots + idle */
+
+    size_t acquires;        /* arena_cache_acquire calls */
+    size_t hits;            /* served from the idle stack */
+} ArenaCache;
+
+/*
+ Fixed-size slots carved from an arena, for objects that are freed
+ one by one before the phase ends. Freed slots are chained through
+ their first word and handed out again before the arena is bumped.
+*/
+typedef struct ArenaPool {
+    Arena *arena;           /* slots are carved from here */
+    size_t slot_size;       /* rounded to align, >= sizeof(void *) */
+    size_t align;           /* slot alignment */
+    void *free_list;        /* freed slots, newest first */
+    ArenaMark mark;         /* arena position before the first slot */
+    size_t live;            /* slots handed out and not freed */
+    size_t carved;          /* slots taken from the arena */
+} ArenaPool;
+
+/* Slab size classes: 16, 32, 64, ... 4096 bytes */
+#define ARENA_SLAB_MIN     16
+#define ARENA_SLAB_MAX     4096
+#define ARENA_SLAB_CLASSES 9
+#define ARENA_SLAB_BYTES   (64u * 1024) /* carved per refill */
+
+/* One size class: a slab being carved plus the slots freed back */
+typedef struct ArenaSlabClass {
+    size_t slot_size;
+    void *free_list;        /* freed slots, newest first */
+    unsigned char *cursor;  /* next uncarved slot in the current slab */
+    unsigned char *end;     /* end of the current slab */
+    size_t live;            /* slots handed out and not freed */
+    size_t peak;            /* highest `live` since the last reset */
+    size_t slabs;           /* slabs taken from the arena */
+} ArenaSlabClass;
+
+/*
+ Small-object allocator over an arena: sizes up to ARENA_SLAB_MAX are
+ rounded to a power-of-two class and can be freed one by one (the
+ caller passes the size back, as with arena_resize); larger requests
+ are plain arena allocations that live until the reset.
+*/
+typedef struct ArenaSlab {
+    Arena *arena;
+    ArenaMark mark;         /* arena position before the first slab */
+    ArenaSlabClass classes[ARENA_SLAB_CLASSES];
+    size_t large_bytes;     /* bytes above ARENA_SLAB_MAX since reset */
+} ArenaSlab;
+
+/*
+ Two-Level Segregated Fit: free blocks are binned by the top bit of
+ their size (first level) and the next ARENA_TLSF_SL_LOG2 bits (second
+ level), with a bitmap per level, so finding a fit and freeing are
+ O(1) bit scans. Sizes are multiples of ARENA_TLSF_ALIGN.
+*/
+#define ARENA_TLSF_ALIGN    16
+#define ARENA_TLSF_SL_LOG2  4
+#define ARENA_TLSF_SL_COUNT (1 << ARENA_TLSF_SL_LOG2)
+#define ARENA_TLSF_FL_SHIFT 8   /* log2(SL_COUNT * ALIGN): below, linear */
+#define ARENA_TLSF_FL_COUNT (sizeof(size_t) * 8 - ARENA_TLSF_FL_SHIFT + 1)
+
+struct ArenaTlsfBlock;      /* header in front of every block */
+
+typedef struct ArenaTlsf {
+    Arena *arena;           /* pools are carved from here */
+    ArenaMark mark;         /* arena position before the first pool */
+    size_t fl_bitmap;       /* first levels with any free block */
+    unsigned sl_bitmap[ARENA_TLSF_FL_COUNT];
+    struct ArenaTlsfBlock *free[ARENA_TLSF_FL_COUNT][ARENA_TLSF_SL_COUNT];
+    struct ArenaTlsfBlock *tail;    /* end sentinel of the newest pool */
+    size_t grow_min;        /* smallest pool, bytes */
+    size_t used;            /* bytes in allocated blocks */
+    size_t peak;            /* highest `used` since the last reset */
+    size_t pooled;          /* bytes taken from the arena */
+    size_t grows;           /* times the arena was asked for more */
+} ArenaTlsf;
+
+/* Buddy orders are log2 block sizes; one list and bitmap per order */
+#define ARENA_BUDDY_ORDERS (sizeof(size_t) * 8)
+
+/* Free list link, kept in the first bytes of every free block */
+typedef struct ArenaBuddyNode {
+    struct ArenaBuddyNode *next;
+    struct ArenaBuddyNode *prev;
+} ArenaBuddyNode;
+
+/*
+ Power-of-two blocks from min_block up to max_block (a top-level
+ block), split on allocation and merged with their buddy on free.
+ Lists are circular with the list head as sentinel, so an ArenaBuddy
+ must not be copied once initialised. Free top-level blocks whose
+ pages went back to the OS sit on no list, only in `purged`.
+*/
+typedef struct ArenaBuddy {
+    Arena *arena;
+    unsigned char *base;    /* first top-level block */
+    unsigned min_order;
+    unsigned max_order;
+    size_t count;           /* top-level blocks */
+    size_t retain;          /* free top-level blocks kept resident */
+    ArenaBuddyNode free[ARENA_BUDDY_ORDERS];
+    unsigned char *bits[ARENA_BUDDY_ORDERS]; /* 1: block free at order */
+    unsigned char *purged;  /* 1: free top-level block, pages given back */
+    size_t resident;        /* free top-level blocks on the list */
+    size_t returned;        /* free top-level blocks in `purged` */
+    size_t used;            /* bytes in allocated blocks */
+    size_t peak;            /* highest `used` since the last reset */
+    size_t splits;
+    size_t merges;
+    size_t purges;          /* madvise calls on freed top-level blocks */
+} ArenaBuddy;
+
 int   arena_init(Arena *a, size_t reserve_size, size_t commit_step);
+int   arena_init_ex(Arena *a, const ArenaConfig *cfg);
+void  arena_config_init(ArenaConfig *cfg, size_t reserve_size,
+                        size_t commit_step);
 void  arena_destroy(Arena *a);
 void  arena_reset(Arena *a);
-void *arena_alloc(Arena *a, size_t size);
+void  arena_reset_decommit(Arena *a, size_t retain);
+size_t arena_high_water(const Arena *a);
+int   arena_numa_node(const Arena *a);
+int   arena_alloc_many(Arena *a, const size_t *sizes, size_t count,
+                       void **out);
+void *arena_alloc_zeroed(Arena *a, size_t size);
+void *arena_alloc_array_zeroed(Arena *a, size_t count, size_t size);
+void *arena_resize(Arena *a, void *ptr, size_t old_size, size_t new_size);
+ArenaMark arena_mark(const Arena *a);
+void  arena_rewind(Arena *a, ArenaMark m);
+void  arena_rewind_decommit(Arena *a, ArenaMark m, size_t retain);
+
+ArenaScratch arena_scratch_begin(Arena *const *conflicts, size_t count);
+void  arena_scratch_end(ArenaScratch s);
+void  arena_scratch_release(void);
+
+int   arena_cache_init(ArenaCache *c, const ArenaConfig *cfg,
+                       size_t count, size_t capacity, size_t retain);
+void  arena_cache_destroy(ArenaCache *c);
+Arena *arena_cache_acquire(ArenaCache *c);
+void  arena_cache_release(ArenaCache *c, Arena *a);
+size_t arena_cache_pooled_bytes(const ArenaCache *c);
+
+int   arena_pool_init(ArenaPool *p, Arena *a, size_t slot_size,
+                      size_t align);
+void  arena_pool_reset(ArenaPool *p);
+
+void  arena_slab_init(ArenaSlab *s, Arena *a);
+void  arena_slab_reset(ArenaSlab *s);
+void *arena_slab_alloc_slow(ArenaSlab *s, size_t size);
+size_t arena_slab_live_bytes(const ArenaSlab *s);
+
+void  arena_tlsf_init(ArenaTlsf *t, Arena *a);
+void  arena_tlsf_reset(ArenaTlsf *t);
+void *arena_tlsf_alloc(ArenaTlsf *t, size_t size);
+void  arena_tlsf_free(ArenaTlsf *t, void *ptr);
+size_t arena_tlsf_block_size(const void *ptr);
+
+int   arena_buddy_init(ArenaBuddy *b, Arena *a, size_t min_block,
+                       size_t max_block, size_t count, size_t retain);
+void  arena_buddy_reset(ArenaBuddy *b);
+void *arena_buddy_alloc(ArenaBuddy *b, size_t size);
+void  arena_buddy_free(ArenaBuddy *b, void *ptr, size_t size);
+size_t arena_buddy_largest_free(const ArenaBuddy *b);
+
+void *arena_alloc_slow(Arena *a, size_t size);
+void *arena_alloc_aligned_slow(Arena *a, size_t size, size_t align);
+void *arena_alloc_large(Arena *a, size_t size, size_t align);
+
+/*
+ Fast path: round to the arena alignment, one compare against commit,
+ bump. Inlined into the caller so the arithmetic folds. Anything that
+ does not fit in the committed range (commit growth, exhaustion) or is
+ above the large threshold goes to arena_alloc_slow, as does a size
+ too close to SIZE_MAX to round, which fails there. For
+ ARENA_OVERCOMMIT arenas commit == limit, so the compare is the bounds
+ check.
+*/
+GIGA_ARENA_INLINE void *arena_alloc(Arena *a, size_t size)
+{
+    unsigned char *p = a->cursor;
+
+    if (size > (size_t)-1 - (a->alignment - 1))
+        return arena_alloc_slow(a, size);
+
+    size = (size + (a->alignment - 1)) & ~(a->alignment - 1);
+
+    if (size <= (size_t)(a->commit - p) && size <= a->large_threshold) {
+        a->cursor = p + size;
+        return p;
+    }
+
+    return arena_alloc_slow(a, size);
+}
+
+/*
+ Allocation aligned to `align`, any power of two up to the arena page
+ size (e.g. 32 for AVX, 64 for a cache line); NULL otherwise. The
+ cursor is padded up to `align`, and the size is still rounded to the
+ arena alignment so plain arena_alloc calls stay aligned afterwards.
+*/
+GIGA_ARENA_INLINE void *arena_alloc_aligned(Arena *a, size_t size,
+                                            size_t align)
+{
+    unsigned char *p = a->cursor;
+    size_t pad, total;
+
+    if (align == 0 || (align & (align - 1)) != 0 || align > a->page_size)
+        return NULL;
+
+    if (size > (size_t)-1 - (a->alignment - 1))
+        return NULL;
+
+    pad   = ((size_t)0 - (size_t)p) & (align - 1);
+    size  = (size + (a->alignment - 1)) & ~(a->alignment - 1);
+    total = size + pad;
+    if (total < size)
+        return NULL;
+
+    if (total <= (size_t)(a->commit - p) && size <= a->large_threshold) {
+        a->cursor = p + total;
+        return p + pad;
+    }
+
+    return arena_alloc_aligned_slow(a, size, align);
+}
+
+/* count * size bytes aligned to `align`; NULL if the product overflows */
+GIGA_ARENA_INLINE void *arena_alloc_array(Arena *a, size_t count,
+                                          size_t size, size_t align)
+{
+    if (size && count > (size_t)-1 / size)
+        return NULL;
+    return arena_alloc_aligned(a, count * size, align);
+}
+
+/* Typed allocation: size and alignment come from T */
+#define ARENA_NEW(a, T) \
+    ((T *)arena_alloc_aligned((a), sizeof(T), ARENA_ALIGNOF(T)))
+
+/* Array of n T; NULL if n * sizeof(T) overflows */
+#define ARENA_NEW_ARRAY(a, T, n) \
+    ((T *)arena_alloc_array((a), (n), sizeof(T), ARENA_ALIGNOF(T)))
+
+/* Pop a freed slot, or carve a new one from the arena */
+GIGA_ARENA_INLINE void *arena_pool_alloc(ArenaPool *p)
+{
+    void *slot = p->free_list;
+
+    if (slot) {
+        p->free_list = *(void **)slot;
+    } else {
+        slot = arena_alloc_aligned(p->arena, p->slot_size, p->align);
+        if (!slot)
+            return NULL;
+        ++p->carved;
+    }
+
+    ++p->live;
+    return slot;
+}
+
+/* Push a slot back (NULL is a no-op); its first word becomes the link */
+GIGA_ARENA_INLINE void arena_pool_free(ArenaPool *p, void *slot)
+{
+    if (!slot)
+        return;
+
+    *(void **)slot = p->free_list;
+    p->free_list = slot;
+    --p->live;
+}
+
+/* Class index for a request of 1..ARENA_SLAB_MAX bytes */
+GIGA_ARENA_INLINE unsigned arena_slab_class(size_t size)
+{
+    unsigned c = 0;
+    size_t slot = ARENA_SLAB_MIN;
+
+    while (slot < size) {
+        slot <<= 1;
+        ++c;
+    }
+    return c;
+}
+
+/* Pop a freed slot of the class; carving and large sizes go slow */
+GIGA_ARENA_INLINE void *arena_slab_alloc(ArenaSlab *s, size_t size)
+{
+    ArenaSlabClass *k;
+    void *slot;
+
+    if (size > ARENA_SLAB_MAX)
+        return arena_slab_alloc_slow(s, size);
+
+    k = &s->classes[arena_slab_class(size)];
+    slot = k->free_list;
+    if (!slot)
+        return arena_slab_alloc_slow(s, size);
+
+    k->free_list = *(void **)slot;
+    if (++k->live > k->peak)
+        k->peak = k->live;
+    return slot;
+}
+
+/* `size` is what was asked of arena_slab_alloc for `ptr` */
+GIGA_ARENA_INLINE void arena_slab_free(ArenaSlab *s, void *ptr, size_t size)
+{
+    ArenaSlabClass *k;
+
+    if (!ptr || size > ARENA_SLAB_MAX)
+        return;
+
+    k = &s->classes[arena_slab_class(size)];
+    *(void **)ptr = k->free_list;
+    k->free_list = ptr;
+    --k->live;
+}
 
 #endif /* GIGA_ARENA_H */
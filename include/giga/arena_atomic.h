@@ -0,0 +1,127 @@
+#ifndef GIGA_ARENA_ATOMIC_H
+#define GIGA_ARENA_ATOMIC_H
+
+/*
+ Concurrent bump arenas (C11 atomics).
+
+ Any number of threads allocate from one reservation; the fast path
+ is a single fetch-add on the cursor. Growing the committed range is
+ serialized on the slow path only. Reset, decommit and destroy are
+ phase boundaries: no allocation may be in flight.
+*/
+
+#if !defined(__STDC_VERSION__) || __STDC_VERSION__ < 201112L
+#error "giga/arena_atomic.h requires C11"
+#endif
+
+#include <stdatomic.h>
+
+#include "arena.h"
+
+typedef struct AtomicArena {
+    Arena arena;            /* reservation; cursor = highest committed end */
+
+    _Atomic size_t cursor;  /* next allocation, bytes from base */
+    _Atomic size_t commit;  /* committed bytes from base */
+    atomic_flag lock;       /* serializes commit growth */
+} AtomicArena;
+
+int   atomic_arena_init(AtomicArena *c, const ArenaConfig *cfg);
+void  atomic_arena_destroy(AtomicArena *c);
+void  atomic_arena_reset(AtomicArena *c);
+void  atomic_arena_reset_decommit(AtomicArena *c, size_t retain);
+void *atomic_arena_alloc_slow(AtomicArena *c, size_t off, size_t end);
+
+/*
+ Fast path: claim [off, off + size), rounded to the arena's alignment,
+ with one relaxed fetch-add; if it ends below the published commit
+ the memory is ready. Otherwise the slow path commits up to `end` (or
+ fails past the reservation).
+*/
+static inline void *atomic_arena_alloc(AtomicArena *c, size_t size)
+{
+    size_t off, end;
+    size_t align = c->arena.alignment;
+
+    /*
+     Never fits, and must not reach the fetch-add: rounding could wrap
+     and the shared cursor would be pushed past the reservation.
+    */
+    if (size > c->arena.reserve_size)
+        return NULL;
+
+    size = (size + (align - 1)) & ~(align - 1);
+
+    off = atomic_fetch_add_explicit(&c->cursor, size, memory_order_relaxed);
+    end = off + size;
+
+    if (end <= atomic_load_explicit(&c->commit, memory_order_acquire))
+        return c->arena.base + off;
+
+    return atomic_arena_alloc_slow(c, off, end);
+}
+
+/*
+ Arena group: per-thread chunks leased from one shared reservation.
+
+ Each thread attaches an ArenaLocal and bump-allocates inside its
+ current chunk with no atomics at all. A chunk is leased from the
+ group's AtomicArena with one fetch-add; lease sizes start at
+ chunk_min and double per lease up to chunk_max. Requests larger
+ than half of chunk_max go straight to the shared arena.
+
+ arena_group_reset empties every attached local and rewinds the
+ shared arena in one go. Like atomic_arena_reset it is a phase
+ boundary: no thread may be allocating.
+*/
+typedef struct ArenaLocal {
+    unsigned char *cursor;      /* next allocation in current chunk */
+    unsigned char *end;         /* end of current chunk */
+    size_t chunk_size;          /* size of the next lease */
+    struct ArenaLocal *next;    /* group registry */
+} ArenaLocal;
+
+typedef struct ArenaGroup {
+    AtomicArena shared;         /* single base..limit for the group */
+
+    size_t chunk_min;           /* first lease size per local */
+    size_t chunk_max;           /* lease size cap */
+
+    ArenaLocal *locals;         /* attached locals */
+    atomic_flag lock;           /* guards `locals` */
+} ArenaGroup;
+
+int   arena_group_init(ArenaGroup *g, const ArenaConfig *cfg,
+                       size_t chunk_min, size_t chunk_max);
+void  arena_group_destroy(ArenaGroup *g);
+void  arena_group_reset(ArenaGroup *g);
+void  arena_local_attach(ArenaGroup *g, ArenaLocal *l);
+void  arena_local_detach(ArenaGroup *g, ArenaLocal *l);
+void *arena_local_alloc_slow(ArenaGroup *g, ArenaLocal *l, size_t size);
+
+/* Fast path: plain bump inside the thread's current chunk */
+static inline void *arena_local_alloc(ArenaGroup *g, ArenaLocal *l,
+                                      size_t size)
+{
+    unsigned char *p = l->cursor;
+    size_t align = g->shared.arena.alignment;
+
+    /* Too large to round: the slow path hands it on and it fails */
+    if (size > (size_t)-1 - (align - 1))
+        return arena_local_alloc_slow(g, l, size);
+
+    size = (size + (align - 1)) & ~(align - 1);
+
+    /*
+     size - 1 wraps for 0, so zero bytes take the slow path too: a
+     local with no chunk yet would otherwise return its NULL cursor.
+    */
+    if (size - 1 < (size_t)(l->end - p)) {
+        l->cursor = p + size;
+        return p;
+    }
+
+    return arena_local_alloc_slow(g, l, size);
+}
+
+#endif /* GIGA_ARENA_ATOMIC_H */
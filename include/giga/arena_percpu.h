@@ -0,0 +1,52 @@
+#ifndef GIGA_ARENA_PERCPU_H
+#define GIGA_ARENA_PERCPU_H
+
+/*
+ Per-CPU sharded arenas (C11 atomics, Linux rseq).
+
+ Every CPU owns a shard: the chunk it currently bumps in. Chunks are
+ leased from one AtomicArena, so memory in flight scales with the
+ number of CPUs, not threads. On x86-64 Linux with glibc's rseq
+ registration the bump is a restartable sequence: no atomics, no
+ locks, restarted by the kernel on preemption or migration. Elsewhere
+ the shard is picked with getcpu and bumped with a compare-exchange.
+
+ Blocks follow the config's alignment, which may be at most 64 bytes
+ (the chunk header size); arena_percpu_init fails otherwise. Reset and
+ destroy are phase boundaries: no allocation may be in flight.
+*/
+
+#if !defined(__STDC_VERSION__) || __STDC_VERSION__ < 201112L
+#error "giga/arena_percpu.h requires C11"
+#endif
+
+#include <stdatomic.h>
+
+#include "arena_atomic.h"
+
+/* One shard per cache line; the rseq fast path relies on this size */
+#define ARENA_SHARD_SIZE 64
+
+struct ArenaPercpuChunk;    /* header at the start of each leased chunk */
+
+typedef struct ArenaShard {
+    _Atomic(struct ArenaPercpuChunk *) chunk;
+    unsigned char pad[ARENA_SHARD_SIZE - sizeof(void *)];
+} ArenaShard;
+
+typedef struct ArenaPercpu {
+    AtomicArena backing;    /* chunks are leased from here */
+    Arena table;            /* holds the shards */
+    ArenaShard *shards;     /* one per configured CPU */
+    unsigned ncpu;
+    size_t chunk_size;      /* bytes per lease, header included */
+    int rseq;               /* 1: rseq fast path, 0: getcpu + CAS */
+} ArenaPercpu;
+
+int   arena_percpu_init(ArenaPercpu *p, const ArenaConfig *cfg,
+                        size_t chunk_size);
+void  arena_percpu_destroy(ArenaPercpu *p);
+void  arena_percpu_reset(ArenaPercpu *p);
+void *arena_percpu_alloc(ArenaPercpu *p, size_t size);
+
+#endif /* GIGA_ARENA_PERCPU_H */
@@ -0,0 +1,67 @@
+#ifndef GIGA_ARENA_PREFAULT_H
+#define GIGA_ARENA_PREFAULT_H
+
+/*
+ Background prefaulting (C11 atomics + POSIX threads).
+
+ A helper thread commits and touches pages ahead of an arena's cursor,
+ keeping `headroom` bytes ready. When the owner crosses `commit` it
+ takes what the helper has published instead of calling mprotect, and
+ its first touch of a new page no longer faults. The owner waits only
+ if the helper falls behind.
+
+ While the helper runs, allocate with arena_prefault_alloc and do not
+ decommit: arena_reset and arena_rewind are fine, arena_reset_decommit
+ and arena_destroy come after arena_prefault_stop. ARENA_OVERCOMMIT
+ and ARENA_CHAINED arenas are not supported.
+*/
+
+#if !defined(__STDC_VERSION__) || __STDC_VERSION__ < 201112L
+#error "giga/arena_prefault.h requires C11"
+#endif
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "arena.h"
+
+typedef struct ArenaPrefault {
+    Arena *arena;           /* owned by the allocating thread */
+    size_t headroom;        /* bytes kept ready past the cursor */
+    size_t chunk;           /* bytes the helper commits per step */
+
+    _Atomic size_t ready;   /* [0, ready) committed and faulted in */
+    _Atomic size_t wanted;  /* owner's cursor + headroom, bytes */
+    _Atomic int running;    /* cleared by arena_prefault_stop */
+    _Atomic int failed;     /* helper's os_commit failed */
+    pthread_t thread;
+
+    size_t refills;         /* commit raised without a syscall */
+    size_t stalls;          /* refills that had to wait for the helper */
+} ArenaPrefault;
+
+int   arena_prefault_start(ArenaPrefault *pf, Arena *a, size_t headroom);
+void  arena_prefault_stop(ArenaPrefault *pf);
+void *arena_prefault_alloc_slow(ArenaPrefault *pf, size_t size);
+
+/* Same fast path as arena_alloc; crossing commit goes to the helper */
+static inline void *arena_prefault_alloc(ArenaPrefault *pf, size_t size)
+{
+    Arena *a = pf->arena;
+    unsigned char *p = a->cursor;
+
+    /* Too large to round: the slow path rejects it */
+    if (size > (size_t)-1 - (a->alignment - 1))
+        return arena_prefault_alloc_slow(pf, size);
+
+    size = (size + (a->alignment - 1)) & ~(a->alignment - 1);
+
+    if (size <= (size_t)(a->commit - p) && size <= a->large_threshold) {
+        a->cursor = p + size;
+        return p;
+    }
+
+    return arena_prefault_alloc_slow(pf, size);
+}
+
+#endif /* GIGA_ARENA_PREFAULT_H */
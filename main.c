@@ -5,6 +5,7 @@
 
 This file implements:
 - A high-performance arena allocator using OS VM primitives
+  (the inline allocation fast path lives in giga/arena.h)
 - A benchmark comparing arena allocation vs malloc/free
 - Proper compiler-proof benchmarking (no dead-code elimination)
 
@@ -12,16 +13,31 @@ Everything is commented. Everything is intentional.
 ============================================================
 */
 
+/* =========================================================
+ * Feature test macros
+ * ========================================================= */
+
+/*
+ Strict -std=c89 hides MAP_ANONYMOUS, madvise and clock_gettime
+ on glibc. Ask for the default POSIX/BSD set before any header.
+*/
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+    #define _DEFAULT_SOURCE 1
+#endif
+
 /* =========================================================
  * Standard headers (C89)
  * ========================================================= */
 
 #include <stdio.h>    /* printf */
 #include <stdlib.h>   /* malloc/free (benchmark only) */
+#include <string.h>   /* strcmp, strncmp */
 #include <stddef.h>   /* size_t */
 #include <stdint.h>   /* uint8_t */
 #include <time.h>     /* time fallback */
 
+#include "giga/arena.h"
+
 /* =========================================================
  * Platform detection
  * ========================================================= */
@@ -31,7 +47,11 @@ Everything is commented. Everything is intentional.
     #include <windows.h>
 #else
     #include <sys/mman.h>   /* mmap, munmap, mprotect */
-    #include <unistd.h>    /* sysconf */
+    #include <unistd.h>    /* sysconf, syscall */
+#endif
+
+#if defined(__linux__)
+    #include <sys/syscall.h> /* SYS_mbind, SYS_get_mempolicy */
 #endif
 
 /* =========================================================
@@ -41,13 +61,129 @@ Everything is commented. Everything is intentional.
 /* Enable guard pages to catch overruns */
 #define ARENA_GUARD_PAGES 1
 
-/* Allocation alignment (power of two) */
-#define ARENA_ALIGNMENT 8
+/*
+ How arena_reset_decommit returns pages to the OS (POSIX).
+ 0: MADV_DONTNEED - RSS drops immediately, pages refault as zero
+ 1: MADV_FREE     - kernel reclaims lazily, only under pressure
+*/
+#define ARENA_DECOMMIT_LAZY 0
+
+/*
+ 1: every arena is ARENA_OVERCOMMIT and arena_alloc_slow is compiled
+ without the commit branch at all (align + bounds check + bump).
+*/
+#define ARENA_ALWAYS_OVERCOMMIT 0
+
+/* Transparent huge page size used by ARENA_HUGE_PAGES */
+#define ARENA_HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+/* hugetlb pool page size used by ARENA_HUGETLB_1G */
+#define ARENA_GIANT_PAGE_SIZE (1024UL * 1024 * 1024)
+
+/*
+ Default cap for the adaptive commit step: each commit while an arena
+ keeps growing doubles the step, up to this. Set commit_step_max to
+ the commit_step for a fixed step.
+*/
+#define ARENA_COMMIT_STEP_MAX (4UL * 1024 * 1024)
+
+/* ARENA_CHAINED: most blocks one arena can chain (sizes double) */
+#define ARENA_CHAIN_MAX 48
+
+/* Per-thread scratch arenas: how many, and how much each reserves */
+#define ARENA_SCRATCH_COUNT   2
+#define ARENA_SCRATCH_RESERVE (256UL * 1024 * 1024)
+#define ARENA_SCRATCH_STEP    (64UL * 1024)
+
+/* Thread-local storage; C89 has no keyword for it */
+#if defined(_MSC_VER)
+    #define ARENA_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+    #define ARENA_THREAD_LOCAL __thread
+#else
+    #define ARENA_THREAD_LOCAL /* no TLS: scratch is process-wide */
+#endif
 
 /* Benchmark parameters */
 #define BENCH_ALLOC_SIZE 64
 #define BENCH_ITERATIONS 10000000UL
 
+/* Walk benchmark: bytes touched and random reads over them */
+#define WALK_BYTES (512UL * 1024 * 1024)
+#define WALK_READS 20000000UL
+
+/* Scope benchmark: scratch scopes and allocations per scope */
+#define SCOPE_FUNCTIONS 100000UL
+#define SCOPE_ALLOCS    64UL
+
+/* Scratch benchmark: requests and temporaries per request */
+#define SCRATCH_REQUESTS 1000000UL
+#define SCRATCH_TEMPS    8UL
+
+/* Alignment benchmark: tiny objects, and SIMD buffer size */
+#define ALIGN_SMALL_COUNT 10000000UL
+#define ALIGN_SIMD_SIZE   96
+
+/* Resize benchmark: builders, final length, bytes per append */
+#define RESIZE_BUILDERS 200UL
+#define RESIZE_LENGTH   16384UL
+#define RESIZE_APPEND   64UL
+
+/* Zeroed benchmark: phases, bytes per phase, committed retain */
+#define ZERO_PHASES      50UL
+#define ZERO_PHASE_BYTES (64UL * 1024 * 1024)
+#define ZERO_RETAIN      (8UL * 1024 * 1024)
+
+/* Batch benchmark: blocks per arena_alloc_many call */
+#define MANY_BATCH 16
+
+/* Chain benchmark: size of the first block */
+#define CHAIN_FIRST (16UL * 1024 * 1024)
+
+/* Large benchmark: phases, small nodes and one big buffer per phase */
+#define LARGE_PHASES    8
+#define LARGE_NODES     65536UL
+#define LARGE_BUFFER    (200UL * 1024 * 1024)
+#define LARGE_THRESHOLD (1024UL * 1024)
+
+/* Commit benchmark: small phases between the big fills */
+#define COMMIT_SMALL_PHASES 1000
+#define COMMIT_SMALL_NODES  256
+
+/* Pool benchmark: live objects in the churn test */
+#define POOL_LIVE 4096
+
+/* Slab benchmark: live objects, and sizes drawn per replacement */
+#define SLAB_LIVE 16384
+
+/* TLSF benchmark: live blocks, operations per pass, histogram size */
+#define TLSF_LIVE    8192
+#define TLSF_OPS     2000000UL
+#define TLSF_BUCKETS 32
+
+/* Buddy benchmark: 4 KiB .. 2 MiB blocks, BUDDY_COUNT top-level ones */
+#define BUDDY_MIN    (4UL * 1024)
+#define BUDDY_MAX    (2UL * 1024 * 1024)
+#define BUDDY_COUNT  256
+#define BUDDY_RETAIN 4
+#define BUDDY_LIVE   1024
+#define BUDDY_OPS    2000000UL
+
+/* NUMA benchmark: bytes faulted in per arena */
+#define NUMA_BYTES (256UL * 1024 * 1024)
+
+/* Populate benchmark: bytes pre-faulted at init (the whole fill) */
+#define POPULATE_BYTES (BENCH_ITERATIONS * BENCH_ALLOC_SIZE)
+
+/* Cache benchmark: requests, and 64 byte nodes per request */
+#define CACHE_REQUESTS 100000UL
+#define CACHE_NODES    2048UL
+#define CACHE_ARENAS   4
+#define CACHE_RETAIN   (128UL * 1024)
+
+/* hugetlb benchmark: bytes filled per arena */
+#define HUGETLB_BYTES (256UL * 1024 * 1024)
+
 /* =========================================================
  * Utility helpers
  * ========================================================= */
@@ -70,20 +206,6 @@ static size_t os_page_size(void)
 #endif
 }
 
-/* =========================================================
- * Arena data structure
- * ========================================================= */
-
-typedef struct Arena {
-    uint8_t *base;        /* usable memory start */
-    uint8_t *cursor;      /* next allocation */
-    uint8_t *commit;      /* committed physical limit */
-    uint8_t *limit;       /* end of reservation */
-
-    size_t reserve_size;  /* usable bytes */
-    size_t commit_step;   /* commit granularity */
-} Arena;
-
 /* =========================================================
  * OS memory primitives
  * ========================================================= */
@@ -102,11 +224,34 @@ static int os_commit(void *addr, size_t size)
     return VirtualAlloc(addr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
 }
 
+static int os_decommit(void *addr, size_t size)
+{
+    return VirtualFree(addr, size, MEM_DECOMMIT) != 0;
+}
+
+static int os_purge(void *addr, size_t size)
+{
+    return VirtualAlloc(addr, size, MEM_RESET, PAGE_READWRITE) != NULL;
+}
+
+/* Recommitted pages are zero; MEM_RESET pages may keep old contents */
+#define OS_DECOMMIT_ZEROES 1
+#define OS_PURGE_ZEROES    0
+
 static void os_release(void *addr)
 {
     VirtualFree(addr, 0, MEM_RELEASE);
 }
 
+/* Fault in committed pages now: one write per page */
+static void os_populate(void *addr, size_t size)
+{
+    size_t page = os_page_size(), off;
+
+    for (off = 0; off < size; off += page)
+        ((volatile uint8_t *)addr)[off] = 0;
+}
+
 static void os_guard(void *addr, size_t size)
 {
     DWORD old;
@@ -130,214 +275,3872 @@ static void *os_reserve(size_t size)
     return (p == MAP_FAILED) ? NULL : p;
 }
 
+/*
+ Reserve already readable and writable. MAP_NORESERVE keeps the
+ range out of commit accounting; pages materialize on first touch.
+*/
+static void *os_reserve_lazy(size_t size)
+{
+    void *p = mmap(
+        NULL,
+        size,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+        -1,
+        0
+    );
+    return (p == MAP_FAILED) ? NULL : p;
+}
+
 static int os_commit(void *addr, size_t size)
 {
     return mprotect(addr, size, PROT_READ | PROT_WRITE) == 0;
 }
 
+/* Drop the physical pages, then make the range inaccessible again */
+static int os_decommit(void *addr, size_t size)
+{
+#if ARENA_DECOMMIT_LAZY && defined(MADV_FREE)
+    if (madvise(addr, size, MADV_FREE) != 0)
+        return 0;
+#else
+    if (madvise(addr, size, MADV_DONTNEED) != 0)
+        return 0;
+#endif
+    return mprotect(addr, size, PROT_NONE) == 0;
+}
+
+/* MADV_FREE pages can come back with their old contents */
+#if ARENA_DECOMMIT_LAZY && defined(MADV_FREE)
+    #define OS_DECOMMIT_ZEROES 0
+    #define OS_PURGE_ZEROES    0
+#else
+    #define OS_DECOMMIT_ZEROES 1
+    #define OS_PURGE_ZEROES    1
+#endif
+
+/* Drop the physical pages but leave the range accessible */
+static int os_purge(void *addr, size_t size)
+{
+#if ARENA_DECOMMIT_LAZY && defined(MADV_FREE)
+    return madvise(addr, size, MADV_FREE) == 0;
+#else
+    return madvise(addr, size, MADV_DONTNEED) == 0;
+#endif
+}
+
 static void os_release(void *addr, size_t size)
 {
     munmap(addr, size);
 }
 
-static void os_guard(void *addr, size_t size)
+/*
+ Fault in committed pages now. MADV_POPULATE_WRITE (Linux 5.14+) does
+ it in one call; older kernels reject it and get one write per page.
+ Fresh pages are zero, so writing a zero keeps them that way.
+*/
+static void os_populate(void *addr, size_t size)
 {
-    mprotect(addr, size, PROT_NONE);
-}
+    size_t page = os_page_size(), off;
 
+#if defined(MADV_POPULATE_WRITE)
+    if (madvise(addr, size, MADV_POPULATE_WRITE) == 0)
+        return;
 #endif
 
-/* =========================================================
- * Arena API
- * ========================================================= */
+    for (off = 0; off < size; off += page)
+        ((volatile uint8_t *)addr)[off] = 0;
+}
 
-int arena_init(Arena *a, size_t reserve_size, size_t commit_step)
+static void os_guard(void *addr, size_t size)
 {
-    size_t page = os_page_size();
-    size_t guard = ARENA_GUARD_PAGES ? page : 0;
+    mprotect(addr, size, PROT_NONE);
+}
 
-    reserve_size = align_up(reserve_size, page);
-    commit_step  = align_up(commit_step, page);
+/*
+ Swap the PROT_NONE range [addr, addr + size) for a mapping backed by
+ the hugetlb pool. Without MAP_NORESERVE the kernel reserves every
+ pool page up front, so an empty or too small pool fails here rather
+ than with SIGBUS on first touch. On failure the plain reservation
+ (lazy RW when `lazy` is set) is put back; returns 0 if that is not
+ possible either.
+*/
+static int os_reserve_hugetlb(void *addr, size_t size, size_t page,
+                              int lazy, int *got)
+{
+    int prot = lazy ? PROT_READ | PROT_WRITE : PROT_NONE;
 
+    *got = 0;
+
+#if defined(MAP_HUGETLB)
     {
-        size_t total = reserve_size + guard * 2;
-        uint8_t *mem = (uint8_t *)os_reserve(total);
-        if (!mem)
-            return 0;
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+        void *p;
 
-        if (ARENA_GUARD_PAGES) {
-            os_guard(mem, guard);
-            os_guard(mem + guard + reserve_size, guard);
+#if defined(MAP_HUGE_SHIFT)
+        int shift = 0;
+        while (((size_t)1 << shift) < page)
+            ++shift;
+        flags |= shift << MAP_HUGE_SHIFT;
+#endif
+#if defined(MAP_FIXED_NOREPLACE)
+        flags |= MAP_FIXED_NOREPLACE;
+#endif
+
+        munmap(addr, size);
+
+        p = mmap(addr, size, prot, flags, -1, 0);
+        if (p == addr) {
+            *got = 1;
+            return 1;
         }
+        if (p != MAP_FAILED)
+            munmap(p, size);
+    }
+#else
+    (void)page;
+    munmap(addr, size);
+#endif
 
-        a->base         = mem + guard;
-        a->cursor       = a->base;
-        a->commit       = a->base;
-        a->limit        = a->base + reserve_size;
-        a->reserve_size = reserve_size;
-        a->commit_step  = commit_step;
+    {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        void *p;
 
-        return 1;
+        if (lazy)
+            flags |= MAP_NORESERVE;
+#if defined(MAP_FIXED_NOREPLACE)
+        flags |= MAP_FIXED_NOREPLACE;
+#endif
+
+        p = mmap(addr, size, prot, flags, -1, 0);
+        if (p == addr)
+            return 1;
+        if (p != MAP_FAILED)
+            munmap(p, size);
+        return 0;
     }
 }
 
-void arena_destroy(Arena *a)
-{
-#if defined(_WIN32)
-    os_release(a->base - (ARENA_GUARD_PAGES ? os_page_size() : 0));
-#else
-    os_release(
-        a->base - (ARENA_GUARD_PAGES ? os_page_size() : 0),
-        a->reserve_size + (ARENA_GUARD_PAGES ? os_page_size() * 2 : 0)
-    );
 #endif
-}
 
-void arena_reset(Arena *a)
+/* =========================================================
+ * NUMA policy (Linux, raw syscalls: no libnuma)
+ * ========================================================= */
+
+/* Node mask wide enough for any kernel (CONFIG_NODES_SHIFT <= 10) */
+#define OS_NUMA_MAX_NODES 1024
+#define OS_NUMA_WORDS (OS_NUMA_MAX_NODES / (8 * sizeof(unsigned long)))
+
+#if defined(__linux__) && defined(SYS_mbind) && defined(SYS_get_mempolicy)
+
+/* <linux/mempolicy.h> values, stable kernel ABI */
+#define OS_MPOL_DEFAULT       0
+#define OS_MPOL_PREFERRED     1
+#define OS_MPOL_BIND          2
+#define OS_MPOL_INTERLEAVE    3
+#define OS_MPOL_F_NODE        (1 << 0)
+#define OS_MPOL_F_ADDR        (1 << 1)
+#define OS_MPOL_F_MEMS_ALLOWED (1 << 2)
+
+/* Nodes this process may allocate from; returns how many, 0 on error */
+static int os_numa_nodes(unsigned long *mask)
 {
-    a->cursor = a->base;
+    int mode, i, count = 0;
+
+    memset(mask, 0, OS_NUMA_WORDS * sizeof(unsigned long));
+    if (syscall(SYS_get_mempolicy, &mode, mask,
+                (unsigned long)OS_NUMA_MAX_NODES, (void *)0,
+                (unsigned long)OS_MPOL_F_MEMS_ALLOWED) != 0)
+        return 0;
+
+    for (i = 0; i < OS_NUMA_MAX_NODES; ++i)
+        count += (mask[i / (8 * sizeof(unsigned long))]
+                  >> (i % (8 * sizeof(unsigned long)))) & 1;
+    return count;
 }
 
-void *arena_alloc(Arena *a, size_t size)
+/* Apply an ARENA_NUMA_* policy to a range that has no pages yet */
+static int os_numa_bind(void *addr, size_t size, int mode,
+                        const unsigned long *mask)
 {
-    uint8_t *next;
-
-    size = align_up(size, ARENA_ALIGNMENT);
-    next = a->cursor + size;
+    int mpol = mode == ARENA_NUMA_BIND      ? OS_MPOL_BIND
+             : mode == ARENA_NUMA_PREFERRED ? OS_MPOL_PREFERRED
+             : OS_MPOL_INTERLEAVE;
 
-    if (next > a->limit)
-        return NULL;
+    return syscall(SYS_mbind, addr, (unsigned long)size, mpol, mask,
+                   (unsigned long)OS_NUMA_MAX_NODES + 1, 0UL) == 0;
+}
 
-    if (next > a->commit) {
-        size_t need = align_up(
-            (size_t)(next - a->commit),
-            a->commit_step
-        );
+/* Node backing the (faulted-in) page at addr, or -1 */
+static int os_numa_node_of(const void *addr)
+{
+    int node = -1;
 
-        if (!os_commit(a->commit, need))
-            return NULL;
+    if (syscall(SYS_get_mempolicy, &node, (unsigned long *)0, 0UL,
+                addr, (unsigned long)(OS_MPOL_F_NODE | OS_MPOL_F_ADDR)) != 0)
+        return -1;
+    return node;
+}
 
-        a->commit += need;
-    }
+#else
 
-    {
-        void *result = a->cursor;
-        a->cursor = next;
-        return result;
-    }
+/* No NUMA control here: report a single node, policies are no-ops */
+static int os_numa_nodes(unsigned long *mask)
+{
+    memset(mask, 0, OS_NUMA_WORDS * sizeof(unsigned long));
+    mask[0] = 1;
+    return 1;
 }
 
-/* =========================================================
- * Timing utilities
- * ========================================================= */
+static int os_numa_bind(void *addr, size_t size, int mode,
+                        const unsigned long *mask)
+{
+    (void)addr; (void)size; (void)mode; (void)mask;
+    return 1;
+}
 
-static double now_seconds(void)
+static int os_numa_node_of(const void *addr)
 {
-#if defined(_WIN32)
-    LARGE_INTEGER freq, counter;
-    QueryPerformanceFrequency(&freq);
-    QueryPerformanceCounter(&counter);
-    return (double)counter.QuadPart / (double)freq.QuadPart;
-#else
-    struct timespec ts;
-#if defined(CLOCK_MONOTONIC)
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
-#else
-    return (double)time(NULL);
-#endif
-#endif
+    (void)addr;
+    return -1;
 }
 
+#endif
+
 /* =========================================================
- * Volatile sinks (prevent optimizer cheating)
+ * Arena API
  * ========================================================= */
 
+/* Page size an arena with these flags asks the OS for */
+static size_t arena_flags_page(unsigned flags)
+{
+    if (flags & ARENA_HUGETLB_1G)
+        return ARENA_GIANT_PAGE_SIZE;
+    if (flags & (ARENA_HUGETLB | ARENA_HUGE_PAGES))
+        return ARENA_HUGE_PAGE_SIZE;
+    return os_page_size();
+}
+
 /*
- These ensure allocations have observable side effects.
- Without them, -O2 can remove entire loops from the benchmark;
+ Reserve one guarded region with `reserve_size` usable bytes (a
+ multiple of *page) and return its usable start, or NULL. Huge page
+ requests that cannot be honored are cleared from *flags, and *page
+ is lowered to match what was actually mapped.
 */
-static volatile void *arena_sink;
-static volatile void *malloc_sink;
+static uint8_t *arena_map(size_t reserve_size, unsigned *flags,
+                          size_t *page)
+{
+    size_t guard = ARENA_GUARD_PAGES ? os_page_size() : 0;
+    size_t total = reserve_size + guard * 2;
+    size_t slack = *page > os_page_size() ? *page : 0;
+    uint8_t *mem;
 
-/* =========================================================
- * Benchmarks
- * ========================================================= */
+#if defined(_WIN32)
+    mem = (uint8_t *)os_reserve(total + slack);
+#else
+    mem = (uint8_t *)((*flags & ARENA_OVERCOMMIT)
+        ? os_reserve_lazy(total + slack)
+        : os_reserve(total + slack));
+#endif
+    if (!mem)
+        return NULL;
 
-static void bench_arena(void)
-{
-    Arena a;
-    size_t i;
-    double t0, t1;
+#if !defined(_WIN32)
+    /* Over-reserve, then trim so that base is huge page aligned */
+    if (slack) {
+        uint8_t *start = (uint8_t *)align_up(
+            (size_t)(mem + guard), *page) - guard;
 
-    if (!arena_init(&a, 1024UL * 1024 * 1024, 64UL * 1024)) {
-        printf("arena_init failed\n");
-        return;
+        if (start > mem)
+            os_release(mem, (size_t)(start - mem));
+        if (mem + slack > start)
+            os_release(start + total, (size_t)(mem + slack - start));
+
+        mem = start;
     }
 
-    t0 = now_seconds();
+    /*
+     Explicit hugetlb pages: try the requested size, then 2 MiB,
+     then keep the plain reservation. flags and page_size report
+     what the arena actually got.
+    */
+    while (*flags & (ARENA_HUGETLB | ARENA_HUGETLB_1G)) {
+        int got;
 
-    for (i = 0; i < BENCH_ITERATIONS; ++i) {
-        arena_sink = arena_alloc(&a, BENCH_ALLOC_SIZE);
-        if (!arena_sink) {
-            printf("arena_alloc failed at %lu\n",
-                   (unsigned long)i);
-            break;
+        if (!os_reserve_hugetlb(mem + guard, reserve_size, *page,
+                                (*flags & ARENA_OVERCOMMIT) != 0,
+                                &got)) {
+            os_release(mem, guard);
+            os_release(mem + guard + reserve_size, guard);
+            return NULL;
         }
+        if (got)
+            break;
+
+        *flags &= (*flags & ARENA_HUGETLB_1G)
+                ? ~ARENA_HUGETLB_1G
+                : ~(ARENA_HUGETLB | ARENA_HUGETLB_1G);
+        *page = arena_flags_page(*flags);
     }
+#endif
 
-    t1 = now_seconds();
+    if (ARENA_GUARD_PAGES) {
+        os_guard(mem, guard);
+        os_guard(mem + guard + reserve_size, guard);
+    }
 
-    printf("ARENA\n");
-    printf("  time      : %.3f sec\n", t1 - t0);
-    printf("  alloc/sec : %.0f\n",
-           BENCH_ITERATIONS / (t1 - t0));
+#if defined(MADV_HUGEPAGE)
+    if ((*flags & ARENA_HUGE_PAGES) &&
+        !(*flags & (ARENA_HUGETLB | ARENA_HUGETLB_1G)))
+        madvise(mem + guard, reserve_size, MADV_HUGEPAGE);
+#endif
 
-    arena_reset(&a);   /* demonstrate API usage */
-    arena_destroy(&a);
+#if defined(_WIN32)
+    /* No lazy commit on Windows: take the charge once, up front */
+    if ((*flags & ARENA_OVERCOMMIT) &&
+        !os_commit(mem + guard, reserve_size)) {
+        os_release(mem);
+        return NULL;
+    }
+#endif
+
+    return mem + guard;
 }
 
-static void bench_malloc(void)
+/* Release a region returned by arena_map */
+static void arena_unmap(uint8_t *base, size_t reserve_size)
 {
-    size_t i;
-    double t0, t1;
+    size_t guard = ARENA_GUARD_PAGES ? os_page_size() : 0;
 
-    t0 = now_seconds();
-
-    for (i = 0; i < BENCH_ITERATIONS; ++i) {
-        void *p = malloc(BENCH_ALLOC_SIZE);
-        if (!p)
-            break;
+#if defined(_WIN32)
+    (void)reserve_size;
+    os_release(base - guard);
+#else
+    os_release(base - guard, reserve_size + guard * 2);
+#endif
+}
 
-        malloc_sink = p; /* force observable write */
-        free(p);
-    }
+/*
+ ARENA_CHAINED block table: ARENA_CHAIN_MAX entries in their own
+ committed pages, so the allocator still never calls malloc.
+*/
+static size_t arena_block_table_size(void)
+{
+    return align_up(ARENA_CHAIN_MAX * sizeof(ArenaBlock), os_page_size());
+}
 
-    t1 = now_seconds();
+static ArenaBlock *arena_block_table_alloc(void)
+{
+    size_t size = arena_block_table_size();
+    void *p = os_reserve(size);
 
-    printf("MALLOC/FREE\n");
-    printf("  time      : %.3f sec\n", t1 - t0);
-    printf("  alloc/sec : %.0f\n",
-           BENCH_ITERATIONS / (t1 - t0));
+    if (p && !os_commit(p, size)) {
+#if defined(_WIN32)
+        os_release(p);
+#else
+        os_release(p, size);
+#endif
+        p = NULL;
+    }
+    return (ArenaBlock *)p;
 }
 
-/* =========================================================
+static void arena_block_table_free(ArenaBlock *blocks)
+{
+#if defined(_WIN32)
+    os_release(blocks);
+#else
+    os_release(blocks, arena_block_table_size());
+#endif
+}
+
+/*
+ Apply the arena's NUMA policy to a fresh range of it: the reservation,
+ a chained block or a large mapping. Pages faulted in later follow it.
+*/
+static int arena_numa_apply(const Arena *a, void *addr, size_t size)
+{
+    unsigned long mask[OS_NUMA_WORDS];
+    size_t bits = 8 * sizeof(unsigned long);
+
+    if (a->numa_mode == ARENA_NUMA_DEFAULT)
+        return 1;
+
+    if (a->numa_mode == ARENA_NUMA_INTERLEAVE) {
+        if (!os_numa_nodes(mask))
+            return 0;
+    } else {
+        memset(mask, 0, sizeof(mask));
+        mask[(size_t)a->numa_node / bits] |=
+            1UL << ((size_t)a->numa_node % bits);
+    }
+
+    return os_numa_bind(addr, size, a->numa_mode, mask);
+}
+
+/*
+ Settle the NUMA policy from the config. With one node (or no NUMA
+ support) every mode quietly becomes ARENA_NUMA_DEFAULT; a node that
+ does not exist on a multi-node machine is an error.
+*/
+static int arena_numa_init(Arena *a, const ArenaConfig *cfg)
+{
+    unsigned long nodes[OS_NUMA_WORDS];
+    size_t bits = 8 * sizeof(unsigned long);
+    int mode = cfg->numa_mode;
+
+    a->numa_mode = ARENA_NUMA_DEFAULT;
+    a->numa_node = -1;
+
+    if (mode == ARENA_NUMA_DEFAULT || os_numa_nodes(nodes) < 2)
+        return 1;
+
+    if (mode != ARENA_NUMA_INTERLEAVE) {
+        int node = cfg->numa_node;
+
+        if (node < 0 || node >= OS_NUMA_MAX_NODES ||
+            !((nodes[(size_t)node / bits] >> ((size_t)node % bits)) & 1))
+            return 0;
+        a->numa_node = node;
+    }
+    a->numa_mode = mode;
+
+    /* A kernel that refuses the policy leaves first-touch placement */
+    if (!arena_numa_apply(a, a->base, a->reserve_size)) {
+        a->numa_mode = ARENA_NUMA_DEFAULT;
+        a->numa_node = -1;
+    }
+    return 1;
+}
+
+/*
+ Node holding the arena's first page; -1 if nothing is faulted in yet
+ or the platform cannot tell. Falls back to the configured node.
+*/
+int arena_numa_node(const Arena *a)
+{
+    int node = -1;
+
+    if (a->commit > a->base &&
+        (a->cursor > a->base || a->touched > a->base ||
+         a->populated > a->base))
+        node = os_numa_node_of(a->base);
+    return node >= 0 ? node : a->numa_node;
+}
+
+/*
+ Commit the first `size` bytes (rounded to the arena page size, capped
+ at the reservation) and fault them in, so a phase that is known to
+ need them pays for the page faults here instead of in the hot path.
+*/
+static int arena_populate(Arena *a, size_t size)
+{
+    uint8_t *end;
+
+    if (size > a->reserve_size)
+        size = a->reserve_size;
+    end = a->base + align_up(size, a->page_size);
+
+    if (end > a->commit) {
+        if (!os_commit(a->commit, (size_t)(end - a->commit)))
+            return 0;
+        a->commit = end;
+        ++a->commit_calls;
+    }
+
+    os_populate(a->base, (size_t)(end - a->base));
+
+    /* Not `touched`: the pages are resident but still zero */
+    if (end > a->populated)
+        a->populated = end;
+    return 1;
+}
+
+int arena_init_ex(Arena *a, const ArenaConfig *cfg)
+{
+    size_t page;
+    size_t reserve_size = cfg->reserve_size;
+    size_t alignment = cfg->alignment ? cfg->alignment : ARENA_ALIGNMENT;
+    unsigned flags = cfg->flags;
+    uint8_t *base;
+    ArenaBlock *blocks = NULL;
+
+    if ((alignment & (alignment - 1)) != 0 || alignment > os_page_size())
+        return 0;
+
+#if ARENA_ALWAYS_OVERCOMMIT
+    flags |= ARENA_OVERCOMMIT;
+#endif
+
+#if defined(_WIN32)
+    /* Large pages need SeLockMemoryPrivilege; not a hint on Windows */
+    flags &= ~(ARENA_HUGE_PAGES | ARENA_HUGETLB | ARENA_HUGETLB_1G);
+#endif
+
+    /*
+     Huge pages only back huge page aligned, huge page sized runs of
+     RW memory, so the usable region and every commit must line up.
+    */
+    page = arena_flags_page(flags);
+    reserve_size = align_up(reserve_size, page);
+
+    if ((flags & ARENA_CHAINED) && !(blocks = arena_block_table_alloc()))
+        return 0;
+
+    base = arena_map(reserve_size, &flags, &page);
+    if (!base) {
+        if (blocks)
+            arena_block_table_free(blocks);
+        return 0;
+    }
+
+    a->base         = base;
+    a->cursor       = a->base;
+    a->limit        = a->base + reserve_size;
+    a->commit       = (flags & ARENA_OVERCOMMIT) ? a->limit : a->base;
+    a->reserve_size = reserve_size;
+    a->commit_min   = align_up(cfg->commit_step, page);
+    a->commit_max   = align_up(cfg->commit_step_max, page);
+    a->commit_step  = a->commit_min;
+    a->commit_calls = 0;
+    a->decommit_calls = 0;
+    a->high_water   = 0;
+    a->released     = 0;
+    a->page_size    = page;
+    a->flags        = flags;
+    a->touched      = a->base;
+    a->populated    = a->base;
+    a->alignment    = alignment;
+    a->resize_in_place = 0;
+    a->resize_copied   = 0;
+    a->blocks       = blocks;
+    a->block_index  = 0;
+    a->block_count  = 0;
+    a->large_threshold = cfg->large_threshold
+                       ? cfg->large_threshold : (size_t)-1;
+    a->large        = NULL;
+    a->large_count  = 0;
+    a->large_bytes  = 0;
+
+    if (a->commit_max < a->commit_min)
+        a->commit_max = a->commit_min;
+
+    if (!arena_numa_init(a, cfg) ||
+        (cfg->populate && !arena_populate(a, cfg->populate))) {
+        /* The chain is still empty: arena_destroy would miss `base` */
+        arena_unmap(base, reserve_size);
+        if (blocks)
+            arena_block_table_free(blocks);
+        return 0;
+    }
+
+    if (blocks) {
+        blocks[0].base    = a->base;
+        blocks[0].commit  = a->commit;
+        blocks[0].limit   = a->limit;
+        blocks[0].touched = a->touched;
+        blocks[0].offset  = 0;
+        a->block_count    = 1;
+    }
+
+    return 1;
+}
+
+void arena_config_init(ArenaConfig *cfg, size_t reserve_size,
+                       size_t commit_step)
+{
+    cfg->reserve_size = reserve_size;
+    cfg->commit_step  = commit_step;
+    cfg->commit_step_max = ARENA_COMMIT_STEP_MAX;
+    cfg->flags        = 0;
+    cfg->alignment    = ARENA_ALIGNMENT;
+    cfg->large_threshold = 0;
+    cfg->populate     = 0;
+    cfg->numa_mode    = ARENA_NUMA_DEFAULT;
+    cfg->numa_node    = 0;
+}
+
+int arena_init(Arena *a, size_t reserve_size, size_t commit_step)
+{
+    ArenaConfig cfg;
+
+    arena_config_init(&cfg, reserve_size, commit_step);
+    return arena_init_ex(a, &cfg);
+}
+
+/* =========================================================
+ * Block chain (ARENA_CHAINED)
+ * ========================================================= */
+
+static void arena_note_cursor(Arena *a);
+
+/* Bytes in use: earlier blocks of the chain plus the current one */
+static size_t arena_used(const Arena *a)
+{
+    size_t used = (size_t)(a->cursor - a->base);
+
+    if (a->blocks)
+        used += a->blocks[a->block_index].offset;
+    return used;
+}
+
+/* Park the current block's state in the table */
+static void arena_block_save(Arena *a)
+{
+    ArenaBlock *b = &a->blocks[a->block_index];
+
+    b->commit  = a->commit;
+    b->touched = a->touched > a->cursor ? a->touched : a->cursor;
+}
+
+/* Make block i current, with the cursor at its start */
+static void arena_block_load(Arena *a, size_t i)
+{
+    ArenaBlock *b = &a->blocks[i];
+
+    a->block_index  = i;
+    a->base         = b->base;
+    a->cursor       = b->base;
+    a->commit       = b->commit;
+    a->limit        = b->limit;
+    a->touched      = b->touched;
+    a->reserve_size = (size_t)(b->limit - b->base);
+}
+
+/* Unmap blocks [from, block_count); `from` must not be current */
+static void arena_chain_release(Arena *a, size_t from)
+{
+    while (a->block_count > from) {
+        ArenaBlock *b = &a->blocks[--a->block_count];
+        uint8_t *top = (a->flags & ARENA_OVERCOMMIT) ? b->touched : b->commit;
+
+        a->released += (size_t)(top - b->base);
+        arena_unmap(b->base, (size_t)(b->limit - b->base));
+    }
+}
+
+/*
+ Index of the block at or below the current one that holds `p` in
+ its used range, or ARENA_CHAIN_MAX if there is none.
+*/
+static size_t arena_chain_find(const Arena *a, const uint8_t *p)
+{
+    size_t i;
+
+    if (p >= a->base && p <= a->cursor)
+        return a->blocks ? a->block_index : 0;
+    if (!a->blocks)
+        return ARENA_CHAIN_MAX;
+
+    for (i = a->block_index; i-- > 0; ) {
+        if (p >= a->blocks[i].base && p <= a->blocks[i].limit)
+            return i;
+    }
+    return ARENA_CHAIN_MAX;
+}
+
+/*
+ The current block cannot fit `size` more bytes. Move to the next
+ block: one kept from an earlier phase if it is big enough, else a
+ fresh reservation twice the size of the current block (or `size`,
+ if larger). The tail of the current block stays unused until reset.
+*/
+static int arena_chain_advance(Arena *a, size_t size)
+{
+    size_t next = a->block_index + 1;
+    size_t offset;
+
+    arena_note_cursor(a);
+    arena_block_save(a);
+    offset = arena_used(a);
+
+    if (next < a->block_count &&
+        (size_t)(a->blocks[next].limit - a->blocks[next].base) < size)
+        arena_chain_release(a, next);
+
+    if (next == a->block_count) {
+        ArenaBlock *b = &a->blocks[next];
+        unsigned flags = a->flags;
+        size_t page = a->page_size;
+        size_t reserve = a->reserve_size * 2;
+        uint8_t *base;
+
+        if (next == ARENA_CHAIN_MAX)
+            return 0;
+        if (reserve < a->reserve_size || reserve < size)
+            reserve = size;
+        if (align_up(reserve, page) < reserve)
+            return 0;
+        reserve = align_up(reserve, page);
+
+        base = arena_map(reserve, &flags, &page);
+        if (!base)
+            return 0;
+
+        b->base    = base;
+        b->limit   = base + reserve;
+        b->commit  = (a->flags & ARENA_OVERCOMMIT) ? b->limit : base;
+        b->touched = base;
+        arena_numa_apply(a, base, reserve);
+        ++a->block_count;
+    }
+
+    a->blocks[next].offset = offset;
+    arena_block_load(a, next);
+    return 1;
+}
+
+/* =========================================================
+ * Large allocations
+ * ========================================================= */
+
+/*
+ Header at the start of each dedicated mapping. The caller's block
+ follows it, padded to the requested alignment.
+*/
+struct ArenaLarge {
+    struct ArenaLarge *next;
+    size_t map_size;
+};
+
+/*
+ Map a region just for this request and push it on the arena's large
+ list. It is unmapped by the reset, rewind or destroy that retires the
+ phase, so one huge buffer never inflates the arena's own commit.
+*/
+void *arena_alloc_large(Arena *a, size_t size, size_t align)
+{
+    size_t header, map_size;
+    struct ArenaLarge *l;
+
+    if (align < a->alignment)
+        align = a->alignment;
+    header = align_up(sizeof(struct ArenaLarge), align);
+
+    map_size = align_up(header + size, os_page_size());
+    if (header + size < size || map_size < header + size)
+        return NULL;
+
+    l = (struct ArenaLarge *)os_reserve(map_size);
+    if (!l)
+        return NULL;
+    arena_numa_apply(a, l, map_size);
+    if (!os_commit(l, map_size)) {
+#if defined(_WIN32)
+        os_release(l);
+#else
+        os_release(l, map_size);
+#endif
+        return NULL;
+    }
+
+    l->next      = a->large;
+    l->map_size  = map_size;
+    a->large     = l;
+    a->large_count += 1;
+    a->large_bytes += map_size;
+
+    return (uint8_t *)l + header;
+}
+
+/* Unmap large allocations, newest first, until `keep` remain */
+static void arena_large_release(Arena *a, size_t keep)
+{
+    while (a->large_count > keep) {
+        struct ArenaLarge *l = a->large;
+
+        a->large        = l->next;
+        a->large_count -= 1;
+        a->large_bytes -= l->map_size;
+        a->released    += l->map_size;
+#if defined(_WIN32)
+        os_release(l);
+#else
+        os_release(l, l->map_size);
+#endif
+    }
+}
+
+/* =========================================================
+ * Reset, decommit and savepoints
+ * ========================================================= */
+
+void arena_destroy(Arena *a)
+{
+    arena_large_release(a, 0);
+
+    if (a->blocks) {
+        arena_chain_release(a, 0);
+        arena_block_table_free(a->blocks);
+        a->blocks = NULL;
+        return;
+    }
+
+    arena_unmap(a->base, a->reserve_size);
+}
+
+/* Fold the current cursor into the usage marks before it moves down */
+static void arena_note_cursor(Arena *a)
+{
+    size_t used = arena_used(a);
+
+    if (used > a->high_water)
+        a->high_water = used;
+    if (a->cursor > a->touched)
+        a->touched = a->cursor;
+}
+
+/*
+ Top of the pages an ARENA_OVERCOMMIT arena may have resident in its
+ current block: the dirty mark, or the populated range in block 0.
+*/
+static uint8_t *arena_resident_top(const Arena *a)
+{
+    uint8_t *top = a->touched;
+
+    if (a->block_index == 0 && a->populated > top)
+        top = a->populated;
+    return a->base + align_up((size_t)(top - a->base), a->page_size);
+}
+
+/*
+ Give every committed page at or above `keep` (page aligned) back to
+ the OS. ARENA_OVERCOMMIT arenas stay mapped RW: the pages resident
+ since the last decommit are purged and commit does not move.
+*/
+static void arena_decommit_above(Arena *a, uint8_t *keep)
+{
+    uint8_t *top;
+    int ok, zeroes;
+
+    top = (a->flags & ARENA_OVERCOMMIT) ? arena_resident_top(a) : a->commit;
+    if (top <= keep)
+        return;
+
+    if (a->flags & ARENA_OVERCOMMIT) {
+        ok = os_purge(keep, (size_t)(top - keep));
+        zeroes = OS_PURGE_ZEROES;
+    } else {
+        ok = os_decommit(keep, (size_t)(top - keep));
+        zeroes = OS_DECOMMIT_ZEROES;
+    }
+    if (!ok)
+        return;
+
+    a->released += (size_t)(top - keep);
+    ++a->decommit_calls;
+    if (!(a->flags & ARENA_OVERCOMMIT))
+        a->commit = keep;
+    if (a->block_index == 0 && a->populated > keep)
+        a->populated = keep;
+
+    /* Only lower the dirty mark if the pages really come back zero */
+    if (zeroes && a->touched > keep)
+        a->touched = keep;
+}
+
+/*
+ Chained arenas go back to the first block and keep the rest for
+ reuse. Large allocations are unmapped, and the commit step drops
+ back to its minimum for the next phase.
+*/
+void arena_reset(Arena *a)
+{
+    arena_note_cursor(a);
+    arena_large_release(a, 0);
+    a->commit_step = a->commit_min;
+
+    if (a->blocks && a->block_index) {
+        arena_block_save(a);
+        arena_block_load(a, 0);
+    }
+
+    a->cursor = a->base;
+}
+
+/*
+ Reset, then give every committed page above base + retain back to
+ the OS. The first `retain` bytes (rounded up to the arena page size)
+ stay committed so the next phase does not refault them. Chained
+ arenas also unmap every block but the first.
+*/
+void arena_reset_decommit(Arena *a, size_t retain)
+{
+    arena_reset(a);
+
+    if (a->blocks)
+        arena_chain_release(a, 1);
+
+    retain = align_up(retain, a->page_size);
+    if (retain > a->reserve_size)
+        retain = a->reserve_size;
+
+    arena_decommit_above(a, a->base + retain);
+}
+
+/*
+ Slow half of arena_alloc_aligned; `size` is already rounded. If a
+ chained arena has to move to a new block, the padding is worked out
+ again against the new cursor.
+*/
+void *arena_alloc_aligned_slow(Arena *a, size_t size, size_t align)
+{
+    size_t pad = ((size_t)0 - (size_t)a->cursor) & (align - 1);
+    uint8_t *p;
+
+    if (size > a->large_threshold)
+        return arena_alloc_large(a, size, align);
+
+    if (a->blocks && size + pad > (size_t)(a->limit - a->cursor)) {
+        if (size + align < size || !arena_chain_advance(a, size + align))
+            return NULL;
+        pad = ((size_t)0 - (size_t)a->cursor) & (align - 1);
+    }
+
+    if (size + pad < size)
+        return NULL;
+
+    p = (uint8_t *)arena_alloc_slow(a, size + pad);
+    return p ? p + pad : NULL;
+}
+
+/*
+ Carve `count` blocks of different sizes in one go: a single pass
+ rounds each size to the arena alignment, parks its offset in out[]
+ and sums them, then one limit/commit check covers the whole batch
+ and the offsets are turned into pointers. Returns 1 and fills
+ out[0..count) on success; on failure returns 0 with the arena
+ unchanged (out[] may hold scratch offsets).
+*/
+int arena_alloc_many(Arena *a, const size_t *sizes, size_t count,
+                     void **out)
+{
+    uint8_t *p;
+    size_t i, total = 0;
+    size_t mask = a->alignment - 1;
+
+    for (i = 0; i < count; ++i) {
+        size_t size = (sizes[i] + mask) & ~mask;
+
+        if (size < sizes[i] || total + size < total)
+            return 0;
+        out[i] = (void *)(uintptr_t)total;
+        total += size;
+    }
+
+    p = (uint8_t *)arena_alloc(a, total);
+    if (!p)
+        return total == 0;
+
+    for (i = 0; i < count; ++i)
+        out[i] = p + (uintptr_t)out[i];
+    return 1;
+}
+
+/*
+ Zeroed allocation. Memory at or above `touched` has not been handed
+ out since the kernel last zeroed it (fresh mmap or decommit), so
+ only the part of the block below that dirty mark is cleared. For an
+ arena that only ever grows this is no memset at all.
+*/
+void *arena_alloc_zeroed(Arena *a, size_t size)
+{
+    uint8_t *p;
+
+    /* Rounding to the arena alignment must not wrap to a tiny block */
+    if (size > (size_t)-1 - (a->alignment - 1))
+        return NULL;
+
+    p = (uint8_t *)arena_alloc(a, size);
+
+    /* Large allocations are fresh mappings, below base or above limit */
+    if (p && p >= a->base && p < a->touched) {
+        size_t dirty = (size_t)(a->touched - p);
+        memset(p, 0, dirty < size ? dirty : size);
+    }
+    return p;
+}
+
+/* calloc-style: count * size with an overflow check */
+void *arena_alloc_array_zeroed(Arena *a, size_t count, size_t size)
+{
+    if (size && count > (size_t)-1 / size)
+        return NULL;
+    return arena_alloc_zeroed(a, count * size);
+}
+
+/*
+ Grow or shrink a block. If `ptr` is the most recent allocation the
+ cursor just moves (committing more if needed); otherwise a shrink
+ keeps the block where it is and a grow allocates and copies.
+ Returns the block's (possibly new) address, or NULL if the arena is
+ out of space, in which case `ptr` is left untouched.
+*/
+void *arena_resize(Arena *a, void *ptr, size_t old_size, size_t new_size)
+{
+    uint8_t *p = (uint8_t *)ptr;
+    size_t old_rounded, new_rounded;
+    void *q;
+
+    /* Rounding must not wrap a huge request into a shrink to 0 */
+    if (new_size > (size_t)-1 - (a->alignment - 1))
+        return NULL;
+
+    if (!p)
+        return arena_alloc(a, new_size);
+
+    old_rounded = align_up(old_size, a->alignment);
+    new_rounded = align_up(new_size, a->alignment);
+
+    /*
+     In place only while the grown block still fits the current block
+     and stays within the large threshold; past it, the copy below
+     moves the block to its own mapping.
+    */
+    if (p + old_rounded == a->cursor &&
+        (new_rounded <= old_rounded ||
+         (new_rounded - old_rounded <= (size_t)(a->limit - a->cursor) &&
+          new_rounded <= a->large_threshold))) {
+        if (new_rounded <= old_rounded) {
+            arena_note_cursor(a);
+            a->cursor = p + new_rounded;
+        } else if (!arena_alloc(a, new_rounded - old_rounded)) {
+            return NULL;
+        }
+
+        ++a->resize_in_place;
+        return p;
+    }
+
+    if (new_size <= old_size) {
+        ++a->resize_in_place;
+        return p;
+    }
+
+    q = arena_alloc(a, new_size);
+    if (!q)
+        return NULL;
+
+    memcpy(q, p, old_size);
+    ++a->resize_copied;
+    return q;
+}
+
+/* Savepoint: everything allocated after this can be rewound in O(1) */
+ArenaMark arena_mark(const Arena *a)
+{
+    ArenaMark m;
+    m.cursor = a->cursor;
+    m.large  = a->large_count;
+    return m;
+}
+
+/*
+ Roll back to a mark. Marks are stack-like: rewinding to a mark that
+ is already above the cursor (an inner scope outlived by an outer
+ rewind or reset) does nothing. In a chained arena the mark may lie
+ in an earlier block; later blocks are kept for reuse.
+*/
+void arena_rewind(Arena *a, ArenaMark m)
+{
+    size_t i = arena_chain_find(a, m.cursor);
+
+    if (i == ARENA_CHAIN_MAX)
+        return;
+
+    arena_note_cursor(a);
+    arena_large_release(a, m.large);
+
+    if (a->blocks && i != a->block_index) {
+        arena_block_save(a);
+        arena_block_load(a, i);
+    }
+
+    a->cursor = m.cursor;
+}
+
+/*
+ Rewind, then decommit above whichever is higher: the mark or
+ base + retain. Pages the outer scope is still using stay put.
+*/
+void arena_rewind_decommit(Arena *a, ArenaMark m, size_t retain)
+{
+    size_t keep;
+
+    arena_rewind(a, m);
+    if (a->cursor != m.cursor)
+        return;
+
+    keep = (size_t)(m.cursor - a->base);
+    if (keep < retain)
+        keep = retain;
+    keep = align_up(keep, a->page_size);
+    if (keep > a->reserve_size)
+        keep = a->reserve_size;
+
+    arena_decommit_above(a, a->base + keep);
+}
+
+/* Peak bytes in use, including the phase still in progress */
+size_t arena_high_water(const Arena *a)
+{
+    size_t used = arena_used(a);
+    return used > a->high_water ? used : a->high_water;
+}
+
+/*
+ Out-of-line half of arena_alloc (see giga/arena.h): the inline fast
+ path lands here only when the aligned request does not fit below
+ commit. Commits more memory, moves to the next block of a chained
+ arena, or fails at the end of the reservation.
+*/
+void *arena_alloc_slow(Arena *a, size_t size)
+{
+    uint8_t *next;
+
+    /* Too large to round: the fast path passes it through unrounded */
+    if (size > (size_t)-1 - (a->alignment - 1))
+        return NULL;
+
+    if (size > a->large_threshold)
+        return arena_alloc_large(a, size, a->alignment);
+
+    if (size > (size_t)(a->limit - a->cursor)) {
+        if (!a->blocks || !arena_chain_advance(a, size))
+            return NULL;
+    }
+
+    next = a->cursor + size;
+
+#if !ARENA_ALWAYS_OVERCOMMIT
+    if (next > a->commit) {
+        size_t need = align_up(
+            (size_t)(next - a->commit),
+            a->commit_step
+        );
+
+        /* The last step is cut short by the end of the reservation */
+        if (need > (size_t)(a->limit - a->commit))
+            need = (size_t)(a->limit - a->commit);
+
+        if (!os_commit(a->commit, need))
+            return NULL;
+
+        a->commit += need;
+        ++a->commit_calls;
+
+        /* Sustained growth: fewer, larger commits, up to commit_max */
+        if (a->commit_step < a->commit_max) {
+            a->commit_step *= 2;
+            if (a->commit_step > a->commit_max)
+                a->commit_step = a->commit_max;
+        }
+    }
+#endif
+
+    {
+        void *result = a->cursor;
+        a->cursor = next;
+        return result;
+    }
+}
+
+/* =========================================================
+ * Scratch arenas
+ * ========================================================= */
+
+/*
+ Each thread owns ARENA_SCRATCH_COUNT arenas, reserved on first use.
+ A function that builds results in arena R asks for scratch with R
+ in `conflicts` and gets a different arena, so rewinding its scratch
+ can never free its results, even when R is itself a scratch arena
+ of a caller further up the stack.
+*/
+static ARENA_THREAD_LOCAL Arena arena_scratch[ARENA_SCRATCH_COUNT];
+
+ArenaScratch arena_scratch_begin(Arena *const *conflicts, size_t count)
+{
+    ArenaScratch s;
+    size_t i, j;
+
+    s.arena = NULL;
+    s.mark.cursor = NULL;
+    s.mark.large  = 0;
+
+    for (i = 0; i < ARENA_SCRATCH_COUNT; ++i) {
+        Arena *a = &arena_scratch[i];
+
+        for (j = 0; j < count; ++j) {
+            if (conflicts[j] == a)
+                break;
+        }
+        if (j < count)
+            continue;
+
+        if (!a->base &&
+            !arena_init(a, ARENA_SCRATCH_RESERVE, ARENA_SCRATCH_STEP))
+            return s;
+
+        s.arena = a;
+        s.mark = arena_mark(a);
+        return s;
+    }
+
+    return s;
+}
+
+void arena_scratch_end(ArenaScratch s)
+{
+    if (s.arena)
+        arena_rewind(s.arena, s.mark);
+}
+
+/* Unmap the calling thread's scratch arenas (call before thread exit) */
+void arena_scratch_release(void)
+{
+    size_t i;
+
+    for (i = 0; i < ARENA_SCRATCH_COUNT; ++i) {
+        if (arena_scratch[i].base) {
+            arena_destroy(&arena_scratch[i]);
+            arena_scratch[i].base = NULL;
+        }
+    }
+}
+
+/* =========================================================
+ * Arena cache
+ * ========================================================= */
+
+/* Bytes an arena holds committed (RW) in its current block */
+static size_t arena_committed(const Arena *a)
+{
+    if (a->flags & ARENA_OVERCOMMIT)
+        return (size_t)(arena_resident_top(a) - a->base);
+    return (size_t)(a->commit - a->base);
+}
+
+/*
+ Set up a cache of up to `capacity` arenas, all built from `cfg`.
+ `count` of them are reserved now with `retain` bytes committed, so
+ the first requests already hit. The Arena structs and the idle stack
+ live in one mapping of their own.
+*/
+int arena_cache_init(ArenaCache *c, const ArenaConfig *cfg,
+                     size_t count, size_t capacity, size_t retain)
+{
+    size_t i;
+
+    if (capacity == 0 || count > capacity ||
+        capacity > (size_t)-1 / (sizeof(Arena) + sizeof(Arena *)))
+        return 0;
+
+    c->config     = *cfg;
+    c->retain     = retain;
+    c->capacity   = capacity;
+    c->count      = 0;
+    c->idle_count = 0;
+    c->acquires   = 0;
+    c->hits       = 0;
+    c->map_size   = align_up(capacity * (sizeof(Arena) + sizeof(Arena *)),
+                             os_page_size());
+
+    c->slots = (Arena *)os_reserve(c->map_size);
+    if (!c->slots)
+        return 0;
+    if (!os_commit(c->slots, c->map_size)) {
+#if defined(_WIN32)
+        os_release(c->slots);
+#else
+        os_release(c->slots, c->map_size);
+#endif
+        return 0;
+    }
+    c->idle = (Arena **)(c->slots + capacity);
+
+    for (i = 0; i < count; ++i) {
+        Arena *a = &c->slots[c->count];
+
+        if (!arena_init_ex(a, &c->config)) {
+            arena_cache_destroy(c);
+            return 0;
+        }
+        ++c->count;
+
+        /* Commit the retained prefix now, as a release would leave it */
+        if (retain && arena_alloc(a, retain))
+            arena_reset(a);
+
+        c->idle[c->idle_count++] = a;
+    }
+
+    return 1;
+}
+
+/* Unmap every arena the cache made, including ones still handed out */
+void arena_cache_destroy(ArenaCache *c)
+{
+    size_t i;
+
+    for (i = 0; i < c->count; ++i)
+        arena_destroy(&c->slots[i]);
+
+#if defined(_WIN32)
+    os_release(c->slots);
+#else
+    os_release(c->slots, c->map_size);
+#endif
+    c->slots = NULL;
+    c->idle  = NULL;
+    c->count = 0;
+    c->idle_count = 0;
+}
+
+/*
+ An idle arena if there is one (a hit: no syscalls at all), else a
+ new one in a free slot. NULL once all `capacity` arenas are out.
+*/
+Arena *arena_cache_acquire(ArenaCache *c)
+{
+    Arena *a;
+
+    ++c->acquires;
+
+    if (c->idle_count) {
+        ++c->hits;
+        return c->idle[--c->idle_count];
+    }
+
+    if (c->count == c->capacity)
+        return NULL;
+
+    a = &c->slots[c->count];
+    if (!arena_init_ex(a, &c->config))
+        return NULL;
+
+    ++c->count;
+    return a;
+}
+
+/*
+ Reset, trim to the cache's retain size, and park for the next
+ acquire. An arena the cache did not make has no slot and is
+ destroyed; one that is already idle is left alone.
+*/
+void arena_cache_release(ArenaCache *c, Arena *a)
+{
+    size_t i;
+
+    if (a < c->slots || a >= c->slots + c->count) {
+        arena_destroy(a);
+        return;
+    }
+    if (c->idle_count >= c->capacity)
+        return;
+    for (i = 0; i < c->idle_count; ++i)
+        if (c->idle[i] == a)
+            return;
+
+    arena_reset_decommit(a, c->retain);
+    c->idle[c->idle_count++] = a;
+}
+
+/* Bytes committed in idle arenas: an upper bound on their RSS */
+size_t arena_cache_pooled_bytes(const ArenaCache *c)
+{
+    size_t i, total = 0;
+
+    for (i = 0; i < c->idle_count; ++i)
+        total += arena_committed(c->idle[i]);
+    return total;
+}
+
+/* =========================================================
+ * Object pool
+ * ========================================================= */
+
+/*
+ Pool of `slot_size` objects aligned to `align` (0: the arena's
+ alignment) on top of `a`. Slots are only carved on demand, so an
+ idle pool costs nothing. Returns 0 for an alignment the arena cannot
+ provide.
+*/
+int arena_pool_init(ArenaPool *p, Arena *a, size_t slot_size, size_t align)
+{
+    if (align == 0)
+        align = a->alignment;
+    if ((align & (align - 1)) != 0 || align > a->page_size)
+        return 0;
+
+    if (slot_size < sizeof(void *))
+        slot_size = sizeof(void *);
+    if (align < ARENA_ALIGNOF(void *))
+        align = ARENA_ALIGNOF(void *);
+    if (align_up(slot_size, align) < slot_size)
+        return 0;
+
+    p->arena     = a;
+    p->slot_size = align_up(slot_size, align);
+    p->align     = align;
+    p->free_list = NULL;
+    p->mark      = arena_mark(a);
+    p->live      = 0;
+    p->carved    = 0;
+
+    return 1;
+}
+
+/*
+ O(1): drop the free list and rewind the arena to where the pool
+ began, releasing every slot at once. Call it whenever the arena is
+ reset or rewound below the pool's slots, so the free list never
+ points into reused memory.
+*/
+void arena_pool_reset(ArenaPool *p)
+{
+    arena_rewind(p->arena, p->mark);
+    p->free_list = NULL;
+    p->live      = 0;
+    p->carved    = 0;
+}
+
+/* =========================================================
+ * Slab allocator
+ * ========================================================= */
+
+/* Slabs start on a cache line, so no slot straddles one needlessly */
+#define ARENA_SLAB_ALIGN 64
+
+void arena_slab_init(ArenaSlab *s, Arena *a)
+{
+    unsigned c;
+
+    s->arena       = a;
+    s->mark        = arena_mark(a);
+    s->large_bytes = 0;
+
+    for (c = 0; c < ARENA_SLAB_CLASSES; ++c) {
+        ArenaSlabClass *k = &s->classes[c];
+
+        k->slot_size = (size_t)ARENA_SLAB_MIN << c;
+        k->free_list = NULL;
+        k->cursor    = NULL;
+        k->end       = NULL;
+        k->live      = 0;
+        k->peak      = 0;
+        k->slabs     = 0;
+    }
+}
+
+/*
+ O(1) in the number of objects: rewind the arena to where the slab
+ allocator began and forget every free list and partial slab. Like
+ arena_pool_reset, call it whenever the arena is reset or rewound
+ below it.
+*/
+void arena_slab_reset(ArenaSlab *s)
+{
+    arena_rewind(s->arena, s->mark);
+    arena_slab_init(s, s->arena);
+}
+
+/*
+ Free list empty: carve the next slot from the class's slab, taking a
+ new ARENA_SLAB_BYTES slab from the arena when it runs out. The tail
+ of the old slab that does not fit a slot is left behind.
+*/
+void *arena_slab_alloc_slow(ArenaSlab *s, size_t size)
+{
+    ArenaSlabClass *k;
+    unsigned char *p;
+
+    if (size > ARENA_SLAB_MAX) {
+        p = (unsigned char *)arena_alloc_aligned(s->arena, size,
+                                                 ARENA_SLAB_ALIGN);
+        if (p)
+            s->large_bytes += size;
+        return p;
+    }
+
+    k = &s->classes[arena_slab_class(size)];
+
+    if (k->free_list) {
+        p = (unsigned char *)k->free_list;
+        k->free_list = *(void **)p;
+    } else {
+        if (k->slot_size > (size_t)(k->end - k->cursor)) {
+            unsigned char *slab = (unsigned char *)arena_alloc_aligned(
+                s->arena, ARENA_SLAB_BYTES, ARENA_SLAB_ALIGN);
+
+            if (!slab)
+                return NULL;
+            k->cursor = slab;
+            k->end    = slab + ARENA_SLAB_BYTES;
+            ++k->slabs;
+        }
+        p = k->cursor;
+        k->cursor += k->slot_size;
+    }
+
+    if (++k->live > k->peak)
+        k->peak = k->live;
+    return p;
+}
+
+/* Bytes in live slots, by class size (excludes large_bytes) */
+size_t arena_slab_live_bytes(const ArenaSlab *s)
+{
+    size_t total = 0;
+    unsigned c;
+
+    for (c = 0; c < ARENA_SLAB_CLASSES; ++c)
+        total += s->classes[c].live * s->classes[c].slot_size;
+    return total;
+}
+
+/* =========================================================
+ * TLSF allocator
+ * ========================================================= */
+
+/*
+ Every block starts with this header; `size` is the payload and its
+ low bit marks the block free. prev_phys is kept for every block, so
+ freeing can merge with both neighbours without boundary tags. The
+ free list links live in the payload and exist only while free.
+*/
+struct ArenaTlsfBlock {
+    struct ArenaTlsfBlock *prev_phys;   /* NULL for a pool's first block */
+    size_t size;
+    struct ArenaTlsfBlock *next_free;
+    struct ArenaTlsfBlock *prev_free;
+};
+
+#define TLSF_FREE     ((size_t)1)
+#define TLSF_HEADER   offsetof(struct ArenaTlsfBlock, next_free)
+#define TLSF_MIN      (sizeof(struct ArenaTlsfBlock) - TLSF_HEADER)
+#define TLSF_SMALL    ((size_t)1 << ARENA_TLSF_FL_SHIFT)
+#define TLSF_MAX      ((size_t)-1 >> 2)     /* rounding cannot overflow */
+
+typedef struct ArenaTlsfBlock TlsfBlock;
+
+/* Index of the lowest / highest set bit; x != 0 */
+static unsigned tlsf_ffs(size_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    if (sizeof(size_t) == sizeof(unsigned long))
+        return (unsigned)__builtin_ctzl((unsigned long)x);
+#endif
+    {
+        unsigned n = 0;
+
+        while (!(x & 1)) {
+            x >>= 1;
+            ++n;
+        }
+        return n;
+    }
+}
+
+static unsigned tlsf_fls(size_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    if (sizeof(size_t) == sizeof(unsigned long))
+        return (unsigned)(sizeof(unsigned long) * 8 - 1
+                          - __builtin_clzl((unsigned long)x));
+#endif
+    {
+        unsigned n = 0;
+
+        while (x >>= 1)
+            ++n;
+        return n;
+    }
+}
+
+static size_t tlsf_size(const TlsfBlock *b)
+{
+    return b->size & ~TLSF_FREE;
+}
+
+static TlsfBlock *tlsf_next_phys(const TlsfBlock *b)
+{
+    return (TlsfBlock *)((unsigned char *)b + TLSF_HEADER + tlsf_size(b));
+}
+
+/* Bin of a free block of `size` bytes */
+static void tlsf_mapping(size_t size, unsigned *fl, unsigned *sl)
+{
+    if (size < TLSF_SMALL) {
+        *fl = 0;
+        *sl = (unsigned)(size / (TLSF_SMALL / ARENA_TLSF_SL_COUNT));
+    } else {
+        unsigned top = tlsf_fls(size);
+
+        *sl = (unsigned)(size >> (top - ARENA_TLSF_SL_LOG2))
+            ^ ARENA_TLSF_SL_COUNT;
+        *fl = top - (ARENA_TLSF_FL_SHIFT - 1);
+    }
+}
+
+/*
+ Round `size` up to the next bin boundary first, so any block in the
+ bin found is large enough: good fit, never a search within a list.
+*/
+static void tlsf_mapping_search(size_t size, unsigned *fl, unsigned *sl)
+{
+    if (size >= TLSF_SMALL)
+        size += ((size_t)1 << (tlsf_fls(size) - ARENA_TLSF_SL_LOG2)) - 1;
+    tlsf_mapping(size, fl, sl);
+}
+
+static void tlsf_insert(ArenaTlsf *t, TlsfBlock *b)
+{
+    unsigned fl, sl;
+    TlsfBlock *head;
+
+    tlsf_mapping(tlsf_size(b), &fl, &sl);
+    head = t->free[fl][sl];
+
+    b->prev_free = NULL;
+    b->next_free = head;
+    if (head)
+        head->prev_free = b;
+    t->free[fl][sl] = b;
+
+    t->fl_bitmap |= (size_t)1 << fl;
+    t->sl_bitmap[fl] |= 1u << sl;
+}
+
+static void tlsf_remove(ArenaTlsf *t, TlsfBlock *b)
+{
+    unsigned fl, sl;
+
+    tlsf_mapping(tlsf_size(b), &fl, &sl);
+
+    if (b->next_free)
+        b->next_free->prev_free = b->prev_free;
+    if (b->prev_free) {
+        b->prev_free->next_free = b->next_free;
+    } else {
+        t->free[fl][sl] = b->next_free;
+        if (!b->next_free) {
+            t->sl_bitmap[fl] &= ~(1u << sl);
+            if (!t->sl_bitmap[fl])
+                t->fl_bitmap &= ~((size_t)1 << fl);
+        }
+    }
+}
+
+/* First non-empty bin at or above (fl, sl), or NULL */
+static TlsfBlock *tlsf_find(ArenaTlsf *t, unsigned fl, unsigned sl)
+{
+    unsigned sl_map;
+
+    if (fl >= ARENA_TLSF_FL_COUNT)
+        return NULL;
+
+    sl_map = t->sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map) {
+        size_t fl_map;
+
+        if (fl + 1 >= ARENA_TLSF_FL_COUNT)
+            return NULL;
+        fl_map = t->fl_bitmap & (~(size_t)0 << (fl + 1));
+        if (!fl_map)
+            return NULL;
+        fl = tlsf_ffs(fl_map);
+        sl_map = t->sl_bitmap[fl];
+    }
+
+    return t->free[fl][tlsf_ffs(sl_map)];
+}
+
+/* Mark `b` free, merge it with free neighbours and bin the result */
+static void tlsf_release(ArenaTlsf *t, TlsfBlock *b)
+{
+    TlsfBlock *next;
+
+    if (b->prev_phys && (b->prev_phys->size & TLSF_FREE)) {
+        TlsfBlock *prev = b->prev_phys;
+
+        tlsf_remove(t, prev);
+        prev->size += TLSF_HEADER + tlsf_size(b);
+        b = prev;
+    }
+
+    next = tlsf_next_phys(b);
+    if (next->size & TLSF_FREE) {
+        tlsf_remove(t, next);
+        b->size += TLSF_HEADER + tlsf_size(next);
+        next = tlsf_next_phys(b);
+    }
+
+    b->size |= TLSF_FREE;
+    next->prev_phys = b;
+    tlsf_insert(t, b);
+}
+
+/*
+ Take a pool of at least `size` payload bytes from the arena; its
+ commit goes through arena_alloc and os_commit. A pool that starts
+ where the previous one ends reuses that pool's end sentinel as its
+ first header, so back-to-back growth yields one contiguous heap
+ (and a free tail merges with it).
+*/
+static int tlsf_grow(ArenaTlsf *t, size_t size)
+{
+    size_t bytes = size + 2 * TLSF_HEADER;
+    unsigned char *region;
+    TlsfBlock *b, *end;
+
+    if (bytes < t->grow_min)
+        bytes = t->grow_min;
+    bytes = align_up(bytes, ARENA_TLSF_ALIGN);
+
+    region = (unsigned char *)arena_alloc_aligned(t->arena, bytes,
+                                                  ARENA_TLSF_ALIGN);
+    if (!region)
+        return 0;
+
+    if (t->tail && region == (unsigned char *)t->tail + TLSF_HEADER) {
+        b = t->tail;
+        b->size = bytes - TLSF_HEADER;
+    } else {
+        b = (TlsfBlock *)region;
+        b->prev_phys = NULL;
+        b->size = bytes - 2 * TLSF_HEADER;
+    }
+
+    end = tlsf_next_phys(b);
+    end->prev_phys = b;
+    end->size = 0;
+
+    t->tail = end;
+    t->pooled += bytes;
+    ++t->grows;
+
+    tlsf_release(t, b);
+    return 1;
+}
+
+/*
+ TLSF heap on top of `a`. Pools are taken on demand, at least one
+ commit step each, and keep the arena's other allocations out of the
+ way only as long as nothing else bumps `a` in between: the arena is
+ best dedicated to the heap.
+*/
+void arena_tlsf_init(ArenaTlsf *t, Arena *a)
+{
+    t->arena     = a;
+    t->mark      = arena_mark(a);
+    t->fl_bitmap = 0;
+    memset(t->sl_bitmap, 0, sizeof(t->sl_bitmap));
+    memset(t->free, 0, sizeof(t->free));
+    t->tail      = NULL;
+    t->grow_min  = a->commit_min;
+    t->used      = 0;
+    t->peak      = 0;
+    t->pooled    = 0;
+    t->grows     = 0;
+}
+
+/* Drop every block at once and rewind the arena below the pools */
+void arena_tlsf_reset(ArenaTlsf *t)
+{
+    arena_rewind(t->arena, t->mark);
+    arena_tlsf_init(t, t->arena);
+}
+
+/*
+ O(1): one bin lookup (after at most one pool grow), then the block
+ is split if the remainder can hold a free block of its own. Returns
+ memory aligned to the block header (16 bytes on 64-bit), or NULL
+ when the arena is out of reservation.
+*/
+void *arena_tlsf_alloc(ArenaTlsf *t, size_t size)
+{
+    unsigned fl, sl;
+    TlsfBlock *b;
+    size_t rest;
+
+    if (size > TLSF_MAX)
+        return NULL;
+    size = size < TLSF_MIN ? TLSF_MIN : align_up(size, ARENA_TLSF_ALIGN);
+
+    tlsf_mapping_search(size, &fl, &sl);
+    b = tlsf_find(t, fl, sl);
+    if (!b) {
+        /* A fresh pool must land in a bin at or above (fl, sl) */
+        size_t want = size;
+
+        if (size >= TLSF_SMALL)
+            want += ((size_t)1 << (tlsf_fls(size) - ARENA_TLSF_SL_LOG2));
+        if (!tlsf_grow(t, want))
+            return NULL;
+        b = tlsf_find(t, fl, sl);
+        if (!b)
+            return NULL;
+    }
+
+    tlsf_remove(t, b);
+    b->size &= ~TLSF_FREE;
+
+    rest = tlsf_size(b) - size;
+    if (rest >= TLSF_HEADER + TLSF_MIN) {
+        TlsfBlock *split = (TlsfBlock *)((unsigned char *)b
+                                         + TLSF_HEADER + size);
+
+        split->prev_phys = b;
+        split->size = rest - TLSF_HEADER;
+        b->size = size;
+        tlsf_release(t, split);
+    }
+
+    t->used += tlsf_size(b);
+    if (t->used > t->peak)
+        t->peak = t->used;
+
+    return (unsigned char *)b + TLSF_HEADER;
+}
+
+void arena_tlsf_free(ArenaTlsf *t, void *ptr)
+{
+    TlsfBlock *b;
+
+    if (!ptr)
+        return;
+
+    b = (TlsfBlock *)((unsigned char *)ptr - TLSF_HEADER);
+    t->used -= tlsf_size(b);
+    tlsf_release(t, b);
+}
+
+/* Usable bytes behind a pointer from arena_tlsf_alloc */
+size_t arena_tlsf_block_size(const void *ptr)
+{
+    return tlsf_size((const TlsfBlock *)((const unsigned char *)ptr
+                                         - TLSF_HEADER));
+}
+
+/* =========================================================
+ * Buddy allocator
+ * ========================================================= */
+
+static int buddy_bit(const ArenaBuddy *b, unsigned order, size_t off)
+{
+    size_t i = off >> order;
+    return (b->bits[order][i >> 3] >> (i & 7)) & 1;
+}
+
+static void buddy_bit_set(ArenaBuddy *b, unsigned order, size_t off)
+{
+    size_t i = off >> order;
+    b->bits[order][i >> 3] |= (unsigned char)(1u << (i & 7));
+}
+
+static void buddy_bit_clear(ArenaBuddy *b, unsigned order, size_t off)
+{
+    size_t i = off >> order;
+    b->bits[order][i >> 3] &= (unsigned char)~(1u << (i & 7));
+}
+
+static void buddy_link(ArenaBuddyNode *after, ArenaBuddyNode *n)
+{
+    n->prev = after;
+    n->next = after->next;
+    after->next->prev = n;
+    after->next = n;
+}
+
+static void buddy_unlink(ArenaBuddyNode *n)
+{
+    n->prev->next = n->next;
+    n->next->prev = n->prev;
+}
+
+/* Smallest order that holds `size`, at least min_order */
+static unsigned buddy_order(const ArenaBuddy *b, size_t size)
+{
+    unsigned order = b->min_order;
+
+    while (((size_t)1 << order) < size)
+        ++order;
+    return order;
+}
+
+/*
+ A top-level block became free. Up to `retain` of them keep their
+ pages and go on the top-order list, so a buffer freed and reallocated
+ every phase does not fault back in. Beyond that the pages go back to
+ the OS (MADV_DONTNEED, or MADV_FREE with ARENA_DECOMMIT_LAZY). Such a
+ block is only recorded in the `purged` bitmap, never linked: a list
+ link written into it, or into a neighbour's, would fault a page
+ straight back in.
+*/
+static void buddy_top_give(ArenaBuddy *b, ArenaBuddyNode *n, size_t off)
+{
+    size_t top = (size_t)1 << b->max_order;
+    size_t k = off >> b->max_order;
+
+    if (b->resident < b->retain || top < b->arena->page_size ||
+        !os_purge(n, top)) {
+        ++b->resident;
+        buddy_bit_set(b, b->max_order, off);
+        buddy_link(&b->free[b->max_order], n);
+        return;
+    }
+
+    b->purged[k >> 3] |= (unsigned char)(1u << (k & 7));
+    ++b->returned;
+    ++b->purges;
+}
+
+/*
+ Every list is empty: take a purged top-level block, found by a scan
+ of the `purged` bitmap (count / 8 bytes). Its pages fault in afresh.
+*/
+static ArenaBuddyNode *buddy_top_unpurge(ArenaBuddy *b)
+{
+    size_t i, bytes = (b->count + 7) / 8;
+    size_t k;
+
+    for (i = 0; i < bytes; ++i) {
+        if (b->purged[i])
+            break;
+    }
+    if (i == bytes)
+        return NULL;
+
+    k = i * 8 + tlsf_ffs(b->purged[i]);
+    b->purged[i] &= (unsigned char)~(1u << (k & 7));
+    --b->returned;
+    return (ArenaBuddyNode *)(b->base + (k << b->max_order));
+}
+
+/*
+ Carve `count` top-level blocks of `max_block` bytes, plus one bitmap
+ per order, out of `a`. Block sizes are powers of two with min_block
+ large enough for a list link. Returns 0 on bad sizes or when the
+ arena cannot hold the region; `a` is then left as it was.
+*/
+int arena_buddy_init(ArenaBuddy *b, Arena *a, size_t min_block,
+                     size_t max_block, size_t count, size_t retain)
+{
+    ArenaMark m;
+    size_t k;
+    unsigned o;
+
+    if (min_block < sizeof(ArenaBuddyNode) || max_block < min_block ||
+        (min_block & (min_block - 1)) != 0 ||
+        (max_block & (max_block - 1)) != 0 || count == 0 ||
+        count > ((size_t)-1 >> 1) / max_block)
+        return 0;
+
+    m = arena_mark(a);
+    b->arena     = a;
+    b->min_order = tlsf_fls(min_block);
+    b->max_order = tlsf_fls(max_block);
+    b->count     = count;
+    b->retain    = retain;
+
+    for (o = 0; o < ARENA_BUDDY_ORDERS; ++o)
+        b->bits[o] = NULL;
+
+    for (o = b->min_order; o <= b->max_order; ++o) {
+        size_t blocks = count << (b->max_order - o);
+
+        b->bits[o] = (unsigned char *)arena_alloc_zeroed(a, (blocks + 7) / 8);
+        if (!b->bits[o]) {
+            arena_rewind(a, m);
+            return 0;
+        }
+    }
+
+    b->purged = (unsigned char *)arena_alloc_zeroed(a, (count + 7) / 8);
+    b->base = (unsigned char *)arena_alloc_aligned(a, count * max_block,
+                                                   a->page_size);
+    if (!b->purged || !b->base) {
+        arena_rewind(a, m);
+        return 0;
+    }
+
+    /* Fresh pages were never touched: nothing to purge yet */
+    for (k = 0; k < count; ++k)
+        b->purged[k >> 3] |= (unsigned char)(1u << (k & 7));
+    arena_buddy_reset(b);
+    return 1;
+}
+
+/*
+ Free every block at once: clear the bitmaps, put the resident
+ top-level blocks back on the list and purge all beyond `retain`.
+ O(count), with no walk over what was allocated.
+*/
+void arena_buddy_reset(ArenaBuddy *b)
+{
+    size_t top = (size_t)1 << b->max_order;
+    size_t k;
+    unsigned o;
+
+    for (o = 0; o < ARENA_BUDDY_ORDERS; ++o) {
+        b->free[o].next = &b->free[o];
+        b->free[o].prev = &b->free[o];
+    }
+    for (o = b->min_order; o <= b->max_order; ++o)
+        memset(b->bits[o], 0,
+               ((b->count << (b->max_order - o)) + 7) / 8);
+
+    b->resident = 0;
+    b->returned = 0;
+    b->used     = 0;
+    b->peak     = 0;
+    b->splits   = 0;
+    b->merges   = 0;
+    b->purges   = 0;
+
+    for (k = 0; k < b->count; ++k) {
+        if (b->purged[k >> 3] & (1u << (k & 7)))
+            ++b->returned;
+        else
+            buddy_top_give(b, (ArenaBuddyNode *)(b->base + k * top),
+                           k * top);
+    }
+}
+
+/*
+ Smallest non-empty order that fits, split down to size: O(orders),
+ plus a bitmap scan when only purged top-level blocks are left.
+*/
+void *arena_buddy_alloc(ArenaBuddy *b, size_t size)
+{
+    unsigned order, o;
+    ArenaBuddyNode *n;
+    size_t off;
+
+    if (size > ((size_t)1 << b->max_order))
+        return NULL;
+    order = buddy_order(b, size);
+
+    for (o = order; o <= b->max_order; ++o) {
+        if (b->free[o].next != &b->free[o])
+            break;
+    }
+
+    if (o <= b->max_order) {
+        n = b->free[o].next;
+        buddy_unlink(n);
+        off = (size_t)((unsigned char *)n - b->base);
+        buddy_bit_clear(b, o, off);
+        if (o == b->max_order)
+            --b->resident;
+    } else {
+        n = buddy_top_unpurge(b);
+        if (!n)
+            return NULL;
+        o = b->max_order;
+        off = (size_t)((unsigned char *)n - b->base);
+    }
+
+    while (o > order) {
+        --o;
+        buddy_link(&b->free[o],
+                   (ArenaBuddyNode *)((unsigned char *)n + ((size_t)1 << o)));
+        buddy_bit_set(b, o, off + ((size_t)1 << o));
+        ++b->splits;
+    }
+
+    b->used += (size_t)1 << order;
+    if (b->used > b->peak)
+        b->peak = b->used;
+    return n;
+}
+
+/*
+ `size` is what was asked of arena_buddy_alloc for `ptr`. Merge with
+ the buddy for as long as it is free, one bitmap test per order.
+*/
+void arena_buddy_free(ArenaBuddy *b, void *ptr, size_t size)
+{
+    unsigned order;
+    size_t off;
+
+    if (!ptr)
+        return;
+
+    order = buddy_order(b, size);
+    off = (size_t)((unsigned char *)ptr - b->base);
+    b->used -= (size_t)1 << order;
+
+    while (order < b->max_order) {
+        size_t buddy = off ^ ((size_t)1 << order);
+
+        if (!buddy_bit(b, order, buddy))
+            break;
+        buddy_bit_clear(b, order, buddy);
+        buddy_unlink((ArenaBuddyNode *)(b->base + buddy));
+        off &= ~((size_t)1 << order);
+        ++order;
+        ++b->merges;
+    }
+
+    if (order == b->max_order) {
+        buddy_top_give(b, (ArenaBuddyNode *)(b->base + off), off);
+    } else {
+        buddy_bit_set(b, order, off);
+        buddy_link(&b->free[order], (ArenaBuddyNode *)(b->base + off));
+    }
+}
+
+/* Biggest block arena_buddy_alloc could return right now, or 0 */
+size_t arena_buddy_largest_free(const ArenaBuddy *b)
+{
+    unsigned o;
+
+    if (b->returned)
+        return (size_t)1 << b->max_order;
+
+    for (o = b->max_order + 1; o-- > b->min_order; ) {
+        if (b->free[o].next != &b->free[o])
+            return (size_t)1 << o;
+    }
+    return 0;
+}
+
+#ifndef GIGA_ARENA_NO_MAIN
+
+/* =========================================================
+ * Timing utilities
+ * ========================================================= */
+
+static double now_seconds(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+#if defined(CLOCK_MONOTONIC)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#else
+    return (double)time(NULL);
+#endif
+#endif
+}
+
+/* =========================================================
+ * Volatile sinks (prevent optimizer cheating)
+ * ========================================================= */
+
+/*
+ These ensure allocations have observable side effects.
+ Without them, -O2 can remove entire loops from the benchmark;
+*/
+static void *volatile arena_sink;
+static void *volatile malloc_sink;
+static volatile unsigned long walk_sink;
+
+/* =========================================================
+ * Benchmarks
+ * ========================================================= */
+
+static void bench_arena(void)
+{
+    Arena a;
+    size_t i;
+    double t0, t1;
+
+    if (!arena_init(&a, 1024UL * 1024 * 1024, 64UL * 1024)) {
+        printf("arena_init failed\n");
+        return;
+    }
+
+    t0 = now_seconds();
+
+    for (i = 0; i < BENCH_ITERATIONS; ++i) {
+        arena_sink = arena_alloc(&a, BENCH_ALLOC_SIZE);
+        if (!arena_sink) {
+            printf("arena_alloc failed at %lu\n",
+                   (unsigned long)i);
+            break;
+        }
+    }
+
+    t1 = now_seconds();
+
+    printf("ARENA\n");
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  alloc/sec : %.0f\n",
+           BENCH_ITERATIONS / (t1 - t0));
+
+    printf("  peak      : %lu KiB\n",
+           (unsigned long)(arena_high_water(&a) / 1024));
+    printf("  commits   : %lu\n", (unsigned long)a.commit_calls);
+
+    /* demonstrate API usage: keep 1 MiB warm, return the rest */
+    arena_reset_decommit(&a, 1024UL * 1024);
+    printf("  released  : %lu KiB\n",
+           (unsigned long)(a.released / 1024));
+
+    arena_destroy(&a);
+}
+
+static void bench_malloc(void)
+{
+    size_t i;
+    double t0, t1;
+
+    t0 = now_seconds();
+
+    for (i = 0; i < BENCH_ITERATIONS; ++i) {
+        void *p = malloc(BENCH_ALLOC_SIZE);
+        if (!p)
+            break;
+
+        malloc_sink = p; /* force observable write */
+        free(p);
+    }
+
+    t1 = now_seconds();
+
+    printf("MALLOC/FREE\n");
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  alloc/sec : %.0f\n",
+           BENCH_ITERATIONS / (t1 - t0));
+}
+
+static void bench_alloc(void)
+{
+    printf("alloc size : %d bytes\n", BENCH_ALLOC_SIZE);
+    printf("iterations : %lu\n\n",
+           (unsigned long)BENCH_ITERATIONS);
+
+    bench_arena();
+    printf("\n");
+    bench_malloc();
+}
+
+/*
+ Huge pages resident in this process, in KiB. Linux only; returns
+ 0 when /proc/self/smaps_rollup is not available.
+*/
+static unsigned long anon_huge_kib(void)
+{
+    unsigned long kib = 0;
+    char line[256];
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+
+    if (!f)
+        return 0;
+
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "AnonHugePages:", 14) == 0) {
+            sscanf(line + 14, "%lu", &kib);
+            break;
+        }
+    }
+
+    fclose(f);
+    return kib;
+}
+
+/*
+ Allocate WALK_BYTES in 64 byte objects, then read them back in a
+ pseudo-random order. Every read lands on a different page, so the
+ run time is dominated by dTLB misses and page walks.
+*/
+static void bench_walk_one(const char *name, unsigned flags)
+{
+    Arena a;
+    ArenaConfig cfg;
+    unsigned long huge_before;
+    size_t count = WALK_BYTES / BENCH_ALLOC_SIZE;
+    size_t i, idx;
+    unsigned long sum = 0;
+    uint8_t *first;
+    double t0, t1;
+
+    arena_config_init(&cfg, 1024UL * 1024 * 1024, 64UL * 1024);
+    cfg.flags = flags;
+
+    if (!arena_init_ex(&a, &cfg)) {
+        printf("arena_init_ex failed\n");
+        return;
+    }
+
+    huge_before = anon_huge_kib();
+
+    first = (uint8_t *)arena_alloc(&a, BENCH_ALLOC_SIZE);
+    first[0] = 1;
+    for (i = 1; i < count; ++i) {
+        uint8_t *p = (uint8_t *)arena_alloc(&a, BENCH_ALLOC_SIZE);
+        if (!p) {
+            printf("arena_alloc failed at %lu\n", (unsigned long)i);
+            arena_destroy(&a);
+            return;
+        }
+        p[0] = (uint8_t)i;
+    }
+
+    t0 = now_seconds();
+
+    /* LCG over object indices: no spatial locality between reads */
+    idx = 1;
+    for (i = 0; i < WALK_READS; ++i) {
+        idx = (idx * 1103515245UL + 12345UL) % count;
+        sum += first[idx * BENCH_ALLOC_SIZE];
+    }
+
+    t1 = now_seconds();
+    walk_sink = sum;
+
+    printf("%s\n", name);
+    printf("  commit    : %lu KiB step\n",
+           (unsigned long)(a.commit_min / 1024));
+    printf("  huge      : %lu KiB\n",
+           anon_huge_kib() - huge_before);
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  reads/sec : %.0f\n", WALK_READS / (t1 - t0));
+
+    arena_destroy(&a);
+}
+
+static void bench_walk(void)
+{
+    printf("walk size  : %lu MiB\n",
+           (unsigned long)(WALK_BYTES / (1024 * 1024)));
+    printf("reads      : %lu\n\n", (unsigned long)WALK_READS);
+
+    bench_walk_one("ARENA (4 KiB pages)", 0);
+    printf("\n");
+    bench_walk_one("ARENA (ARENA_HUGE_PAGES)", ARENA_HUGE_PAGES);
+}
+
+/* Free minus reserved pages in the hugetlb pool of a given size */
+static unsigned long hugetlb_pool_free(size_t page)
+{
+    unsigned long free_pages = 0, resv_pages = 0;
+    char path[128];
+    FILE *f;
+
+    sprintf(path, "/sys/kernel/mm/hugepages/hugepages-%lukB/free_hugepages",
+            (unsigned long)(page / 1024));
+    if ((f = fopen(path, "r")) != NULL) {
+        if (fscanf(f, "%lu", &free_pages) != 1)
+            free_pages = 0;
+        fclose(f);
+    }
+
+    sprintf(path, "/sys/kernel/mm/hugepages/hugepages-%lukB/resv_hugepages",
+            (unsigned long)(page / 1024));
+    if ((f = fopen(path, "r")) != NULL) {
+        if (fscanf(f, "%lu", &resv_pages) != 1)
+            resv_pages = 0;
+        fclose(f);
+    }
+
+    return free_pages > resv_pages ? free_pages - resv_pages : 0;
+}
+
+static const char *arena_backing_name(const Arena *a)
+{
+    if (a->flags & ARENA_HUGETLB_1G)
+        return "hugetlb 1 GiB";
+    if (a->flags & ARENA_HUGETLB)
+        return "hugetlb 2 MiB";
+    if (a->flags & ARENA_HUGE_PAGES)
+        return "THP";
+    return "base pages";
+}
+
+/*
+ Report which backend each hugetlb request ended up with, then time
+ a fill of the arena. The fill is where hugetlb pays off: one fault
+ per huge page and no khugepaged collapse later.
+*/
+static void bench_hugetlb_one(const char *name, unsigned flags)
+{
+    Arena a;
+    ArenaConfig cfg;
+    size_t i, count = HUGETLB_BYTES / BENCH_ALLOC_SIZE;
+    double t0, t1;
+
+    arena_config_init(&cfg, HUGETLB_BYTES, 64UL * 1024);
+    cfg.flags = flags;
+
+    if (!arena_init_ex(&a, &cfg)) {
+        printf("arena_init_ex failed\n");
+        return;
+    }
+
+    t0 = now_seconds();
+
+    for (i = 0; i < count; ++i) {
+        uint8_t *p = (uint8_t *)arena_alloc(&a, BENCH_ALLOC_SIZE);
+        if (!p) {
+            printf("arena_alloc failed at %lu\n", (unsigned long)i);
+            break;
+        }
+        p[0] = (uint8_t)i;
+    }
+
+    t1 = now_seconds();
+
+    printf("%s\n", name);
+    printf("  got       : %s (%lu KiB pages)\n",
+           arena_backing_name(&a), (unsigned long)(a.page_size / 1024));
+    printf("  fill time : %.3f sec\n", t1 - t0);
+
+    arena_destroy(&a);
+}
+
+static void bench_hugetlb(void)
+{
+    printf("fill size  : %lu MiB\n",
+           (unsigned long)(HUGETLB_BYTES / (1024 * 1024)));
+    printf("pool 2 MiB : %lu free\n",
+           hugetlb_pool_free(ARENA_HUGE_PAGE_SIZE));
+    printf("pool 1 GiB : %lu free\n\n",
+           hugetlb_pool_free(ARENA_GIANT_PAGE_SIZE));
+
+    bench_hugetlb_one("ARENA (base pages)", 0);
+    printf("\n");
+    bench_hugetlb_one("ARENA (ARENA_HUGETLB)", ARENA_HUGETLB);
+    printf("\n");
+    bench_hugetlb_one("ARENA (ARENA_HUGETLB_1G)", ARENA_HUGETLB_1G);
+}
+
+/*
+ Same loop as bench_arena, without touching the memory: what is left
+ is the bump itself plus, for the default path, one mprotect per
+ commit_step. ARENA_OVERCOMMIT never leaves the fast path.
+*/
+static void bench_overcommit_one(const char *name, unsigned flags)
+{
+    Arena a;
+    ArenaConfig cfg;
+    size_t i;
+    double t0, t1;
+
+    arena_config_init(&cfg, 1024UL * 1024 * 1024, 64UL * 1024);
+    cfg.flags = flags;
+
+    if (!arena_init_ex(&a, &cfg)) {
+        printf("arena_init_ex failed\n");
+        return;
+    }
+
+    t0 = now_seconds();
+
+    for (i = 0; i < BENCH_ITERATIONS; ++i) {
+        arena_sink = arena_alloc(&a, BENCH_ALLOC_SIZE);
+        if (!arena_sink) {
+            printf("arena_alloc failed at %lu\n", (unsigned long)i);
+            break;
+        }
+    }
+
+    t1 = now_seconds();
+
+    printf("%s\n", name);
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  alloc/sec : %.0f\n", BENCH_ITERATIONS / (t1 - t0));
+
+    arena_destroy(&a);
+}
+
+static void bench_overcommit(void)
+{
+    printf("alloc size : %d bytes\n", BENCH_ALLOC_SIZE);
+    printf("iterations : %lu\n\n",
+           (unsigned long)BENCH_ITERATIONS);
+
+    bench_overcommit_one("ARENA (os_commit)", 0);
+    printf("\n");
+    bench_overcommit_one("ARENA (ARENA_OVERCOMMIT)", ARENA_OVERCOMMIT);
+}
+
+/*
+ Per-module phase with per-function scratch inside it: every
+ function takes a mark, allocates scratch, and rewinds. Compare with
+ the same loop done by an arena_init/arena_destroy per function.
+*/
+static void bench_scope(void)
+{
+    Arena a;
+    size_t i, j;
+    double t0, t1;
+
+    printf("functions  : %lu\n", (unsigned long)SCOPE_FUNCTIONS);
+    printf("scratch    : %lu x %d bytes\n\n",
+           (unsigned long)SCOPE_ALLOCS, BENCH_ALLOC_SIZE);
+
+    if (!arena_init(&a, 1024UL * 1024 * 1024, 64UL * 1024)) {
+        printf("arena_init failed\n");
+        return;
+    }
+
+    arena_sink = arena_alloc(&a, 4096); /* per-module results */
+
+    t0 = now_seconds();
+
+    for (i = 0; i < SCOPE_FUNCTIONS; ++i) {
+        ArenaMark m = arena_mark(&a);
+
+        for (j = 0; j < SCOPE_ALLOCS; ++j)
+            arena_sink = arena_alloc(&a, BENCH_ALLOC_SIZE);
+
+        arena_rewind(&a, m);
+    }
+
+    t1 = now_seconds();
+
+    printf("ARENA (arena_mark / arena_rewind)\n");
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  scopes/sec: %.0f\n", SCOPE_FUNCTIONS / (t1 - t0));
+    printf("  peak      : %lu KiB\n",
+           (unsigned long)(arena_high_water(&a) / 1024));
+
+    arena_destroy(&a);
+
+    t0 = now_seconds();
+
+    for (i = 0; i < SCOPE_FUNCTIONS; ++i) {
+        Arena scratch;
+
+        if (!arena_init(&scratch, 1024UL * 1024, 64UL * 1024)) {
+            printf("arena_init failed\n");
+            return;
+        }
+        for (j = 0; j < SCOPE_ALLOCS; ++j)
+            arena_sink = arena_alloc(&scratch, BENCH_ALLOC_SIZE);
+        arena_destroy(&scratch);
+    }
+
+    t1 = now_seconds();
+
+    printf("\nARENA (arena_init / arena_destroy per scope)\n");
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  scopes/sec: %.0f\n", SCOPE_FUNCTIONS / (t1 - t0));
+}
+
+/*
+ A "request" that builds a result list in `out` and needs a few
+ temporary buffers along the way: the pattern hand-rolled with
+ malloc/free, then with scratch arenas.
+*/
+static void *scratch_request_malloc(Arena *out)
+{
+    size_t i;
+    void *result = arena_alloc(out, BENCH_ALLOC_SIZE);
+
+    for (i = 0; i < SCRATCH_TEMPS; ++i) {
+        void *tmp = malloc(BENCH_ALLOC_SIZE * (i + 1));
+        malloc_sink = tmp;
+        free(tmp);
+    }
+    return result;
+}
+
+static void *scratch_request_arena(Arena *out)
+{
+    size_t i;
+    void *result = arena_alloc(out, BENCH_ALLOC_SIZE);
+    ArenaScratch s = arena_scratch_begin(&out, 1);
+
+    for (i = 0; i < SCRATCH_TEMPS; ++i)
+        arena_sink = arena_alloc(s.arena, BENCH_ALLOC_SIZE * (i + 1));
+
+    arena_scratch_end(s);
+    return result;
+}
+
+static void bench_scratch_one(const char *name, void *(*request)(Arena *))
+{
+    ArenaScratch outer;
+    size_t i;
+    double t0, t1;
+
+    /* Results land in a scratch arena too: conflicts must be honored */
+    outer = arena_scratch_begin(NULL, 0);
+    if (!outer.arena) {
+        printf("arena_scratch_begin failed\n");
+        return;
+    }
+
+    t0 = now_seconds();
+    for (i = 0; i < SCRATCH_REQUESTS; ++i)
+        arena_sink = request(outer.arena);
+    t1 = now_seconds();
+
+    arena_scratch_end(outer);
+
+    printf("%s\n", name);
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  req/sec   : %.0f\n", SCRATCH_REQUESTS / (t1 - t0));
+}
+
+static void bench_scratch(void)
+{
+    printf("requests   : %lu\n", (unsigned long)SCRATCH_REQUESTS);
+    printf("temps      : %lu per request\n\n",
+           (unsigned long)SCRATCH_TEMPS);
+
+    bench_scratch_one("MALLOC/FREE temporaries", scratch_request_malloc);
+    printf("\n");
+    bench_scratch_one("SCRATCH ARENA temporaries", scratch_request_arena);
+
+    arena_scratch_release();
+}
+
+/*
+ Two costs of a fixed 8 byte alignment: padding on tiny objects, and
+ no way to ask for more. Fill ALIGN_SMALL_COUNT 1..4 byte objects at
+ alignment 8 and 1, then carve cache-line aligned SIMD buffers.
+*/
+static void bench_align_small(size_t alignment)
+{
+    Arena a;
+    ArenaConfig cfg;
+    size_t i;
+
+    arena_config_init(&cfg, 256UL * 1024 * 1024, 64UL * 1024);
+    cfg.alignment = alignment;
+
+    if (!arena_init_ex(&a, &cfg)) {
+        printf("arena_init_ex failed\n");
+        return;
+    }
+
+    for (i = 0; i < ALIGN_SMALL_COUNT; ++i)
+        arena_sink = arena_alloc(&a, 1 + i % 4);
+
+    printf("ARENA (alignment %lu, 1..4 byte objects)\n",
+           (unsigned long)alignment);
+    printf("  used      : %lu KiB\n",
+           (unsigned long)(arena_high_water(&a) / 1024));
+
+    arena_destroy(&a);
+}
+
+static void bench_align(void)
+{
+    Arena a;
+    size_t i;
+    unsigned long misaligned = 0;
+    double t0, t1;
+
+    printf("small objs : %lu\n", (unsigned long)ALIGN_SMALL_COUNT);
+    printf("simd bufs  : %lu x %d bytes @ 64\n\n",
+           (unsigned long)BENCH_ITERATIONS, ALIGN_SIMD_SIZE);
+
+    bench_align_small(8);
+    printf("\n");
+    bench_align_small(1);
+    printf("\n");
+
+    if (!arena_init(&a, 1024UL * 1024 * 1024, 64UL * 1024)) {
+        printf("arena_init failed\n");
+        return;
+    }
+
+    t0 = now_seconds();
+
+    for (i = 0; i < BENCH_ITERATIONS; ++i) {
+        /* odd-sized header first so the cursor is never 64-aligned */
+        arena_sink = arena_alloc(&a, 24);
+        arena_sink = arena_alloc_aligned(&a, ALIGN_SIMD_SIZE, 64);
+        if ((size_t)arena_sink & 63)
+            ++misaligned;
+        if ((i & 0xffff) == 0xffff)
+            arena_reset(&a);
+    }
+
+    t1 = now_seconds();
+
+    printf("ARENA (arena_alloc_aligned, 64)\n");
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  alloc/sec : %.0f\n", 2 * BENCH_ITERATIONS / (t1 - t0));
+    printf("  misaligned: %lu\n", misaligned);
+
+    arena_destroy(&a);
+}
+
+/*
+ String builders: RESIZE_BUILDERS buffers grown RESIZE_APPEND bytes
+ at a time up to RESIZE_LENGTH. "Interleaved" puts a small node
+ allocation between appends, so every grow has to copy.
+*/
+static void bench_resize_one(const char *name, int interleave)
+{
+    Arena a;
+    size_t b, len;
+    double t0, t1;
+
+    if (!arena_init(&a, 1024UL * 1024 * 1024, 64UL * 1024)) {
+        printf("arena_init failed\n");
+        return;
+    }
+
+    t0 = now_seconds();
+
+    for (b = 0; b < RESIZE_BUILDERS; ++b) {
+        uint8_t *buf = NULL;
+
+        for (len = 0; len < RESIZE_LENGTH; len += RESIZE_APPEND) {
+            buf = (uint8_t *)arena_resize(&a, buf, len, len + RESIZE_APPEND);
+            if (!buf) {
+                printf("arena_resize failed\n");
+                arena_destroy(&a);
+                return;
+            }
+            buf[len] = (uint8_t)len;
+            if (interleave)
+                arena_sink = arena_alloc(&a, 16);
+        }
+        arena_sink = buf;
+    }
+
+    t1 = now_seconds();
+
+    printf("%s\n", name);
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  used      : %lu KiB\n",
+           (unsigned long)(arena_high_water(&a) / 1024));
+    printf("  in place  : %lu\n", (unsigned long)a.resize_in_place);
+    printf("  copied    : %lu\n", (unsigned long)a.resize_copied);
+
+    arena_destroy(&a);
+}
+
+/*
+ A SIZE_MAX resize must fail and leave the arena alone, whether the
+ block is on top (in-place path) or not (copy path).
+*/
+static void bench_resize_overflow(void)
+{
+    Arena a;
+    void *lower, *top, *r1, *r2;
+    size_t used;
+
+    if (!arena_init(&a, 1024UL * 1024, 64UL * 1024)) {
+        printf("arena_init failed\n");
+        return;
+    }
+
+    lower = arena_alloc(&a, 64);
+    top   = arena_alloc(&a, 64);
+    used  = (size_t)(a.cursor - a.base);
+
+    r1 = arena_resize(&a, top, 64, (size_t)-1);
+    r2 = arena_resize(&a, lower, 64, (size_t)-1);
+
+    printf("SIZE_MAX resize\n");
+    printf("  top block : %s\n", r1 ? "FAILED (non-NULL)" : "NULL");
+    printf("  lower     : %s\n", r2 ? "FAILED (non-NULL)" : "NULL");
+    printf("  cursor    : %s\n",
+           (size_t)(a.cursor - a.base) == used ? "unchanged" : "FAILED");
+
+    arena_destroy(&a);
+}
+
+static void bench_resize(void)
+{
+    printf("builders   : %lu x %lu bytes, +%lu per append\n\n",
+           (unsigned long)RESIZE_BUILDERS, (unsigned long)RESIZE_LENGTH,
+           (unsigned long)RESIZE_APPEND);
+
+    bench_resize_one("ARENA (top of arena, grows in place)", 0);
+    printf("\n");
+    bench_resize_one("ARENA (interleaved, allocate + copy)", 1);
+    printf("\n");
+    bench_resize_overflow();
+}
+
+/*
+ Reset-heavy phases of zeroed allocations. Every phase ends with
+ arena_reset_decommit keeping ZERO_RETAIN committed: only that much
+ is dirty at the start of the next phase, the rest is fresh from the
+ kernel. memset + arena_alloc clears everything every time.
+*/
+static void bench_zeroed_one(const char *name, int use_zeroed)
+{
+    Arena a;
+    size_t phase, i, count = ZERO_PHASE_BYTES / BENCH_ALLOC_SIZE;
+    double t0, t1;
+
+    if (!arena_init(&a, 1024UL * 1024 * 1024, 64UL * 1024)) {
+        printf("arena_init failed\n");
+        return;
+    }
+
+    t0 = now_seconds();
+
+    for (phase = 0; phase < ZERO_PHASES; ++phase) {
+        for (i = 0; i < count; ++i) {
+            void *p;
+
+            if (use_zeroed) {
+                p = arena_alloc_zeroed(&a, BENCH_ALLOC_SIZE);
+            } else {
+                p = arena_alloc(&a, BENCH_ALLOC_SIZE);
+                if (p)
+                    memset(p, 0, BENCH_ALLOC_SIZE);
+            }
+            if (p)
+                *(uint8_t *)p = 1; /* the caller fills it in */
+            arena_sink = p;
+        }
+        arena_reset_decommit(&a, ZERO_RETAIN);
+    }
+
+    t1 = now_seconds();
+
+    printf("%s\n", name);
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  phases/sec: %.0f\n", ZERO_PHASES / (t1 - t0));
+
+    arena_destroy(&a);
+}
+
+static void bench_zeroed(void)
+{
+    printf("phases     : %lu x %lu MiB, retain %lu MiB\n\n",
+           (unsigned long)ZERO_PHASES,
+           (unsigned long)(ZERO_PHASE_BYTES / (1024 * 1024)),
+           (unsigned long)(ZERO_RETAIN / (1024 * 1024)));
+
+    bench_zeroed_one("ARENA (arena_alloc + memset)", 0);
+    printf("\n");
+    bench_zeroed_one("ARENA (arena_alloc_zeroed)", 1);
+}
+
+/* Mixed-size "AST nodes", built MANY_BATCH at a time */
+static const size_t many_sizes[MANY_BATCH] = {
+    24, 40, 16, 56, 32, 24, 72, 16,
+    48, 24, 40, 16, 88, 32, 24, 16
+};
+
+static void bench_many(void)
+{
+    Arena a;
+    void *nodes[MANY_BATCH];
+    size_t i, j, batches = BENCH_ITERATIONS / MANY_BATCH;
+    double t0, t1;
+
+    printf("nodes      : %lu in batches of %d\n\n",
+           (unsigned long)(batches * MANY_BATCH), MANY_BATCH);
+
+    if (!arena_init(&a, 1024UL * 1024 * 1024, 64UL * 1024)) {
+        printf("arena_init failed\n");
+        return;
+    }
+
+    t0 = now_seconds();
+    for (i = 0; i < batches; ++i) {
+        for (j = 0; j < MANY_BATCH; ++j)
+            nodes[j] = arena_alloc(&a, many_sizes[j]);
+        arena_sink = nodes[MANY_BATCH - 1];
+    }
+    t1 = now_seconds();
+
+    printf("ARENA (arena_alloc per node)\n");
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  nodes/sec : %.0f\n", batches * MANY_BATCH / (t1 - t0));
+
+    arena_reset(&a);
+
+    t0 = now_seconds();
+    for (i = 0; i < batches; ++i) {
+        if (!arena_alloc_many(&a, many_sizes, MANY_BATCH, nodes)) {
+            printf("arena_alloc_many failed\n");
+            break;
+        }
+        arena_sink = nodes[MANY_BATCH - 1];
+    }
+    t1 = now_seconds();
+
+    printf("\nARENA (arena_alloc_many)\n");
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  nodes/sec : %.0f\n", batches * MANY_BATCH / (t1 - t0));
+
+    arena_destroy(&a);
+}
+
+/*
+ Fill BENCH_ITERATIONS x 64 bytes into an arena that starts with a
+ CHAIN_FIRST reservation and chains more blocks as it runs out, then
+ refill after arena_reset (blocks are reused) and trim with
+ arena_reset_decommit (all but the first block are unmapped).
+*/
+static void bench_chain_fill(Arena *a, const char *name)
+{
+    size_t i;
+    double t0, t1;
+
+    t0 = now_seconds();
+    for (i = 0; i < BENCH_ITERATIONS; ++i) {
+        arena_sink = arena_alloc(a, BENCH_ALLOC_SIZE);
+        if (!arena_sink) {
+            printf("arena_alloc failed at %lu\n", (unsigned long)i);
+            break;
+        }
+    }
+    t1 = now_seconds();
+
+    printf("%s\n", name);
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  alloc/sec : %.0f\n", BENCH_ITERATIONS / (t1 - t0));
+    printf("  blocks    : %lu\n", (unsigned long)a->block_count);
+}
+
+static void bench_chain(void)
+{
+    Arena a;
+    ArenaConfig cfg;
+
+    printf("alloc size : %d bytes\n", BENCH_ALLOC_SIZE);
+    printf("iterations : %lu\n", (unsigned long)BENCH_ITERATIONS);
+    printf("first block: %lu MiB\n\n",
+           (unsigned long)(CHAIN_FIRST / (1024 * 1024)));
+
+    arena_config_init(&cfg, CHAIN_FIRST, 64UL * 1024);
+    cfg.flags = ARENA_CHAINED;
+
+    if (!arena_init_ex(&a, &cfg)) {
+        printf("arena_init_ex failed\n");
+        return;
+    }
+
+    bench_chain_fill(&a, "ARENA_CHAINED (growing)");
+    printf("\n");
+
+    arena_reset(&a);
+    bench_chain_fill(&a, "ARENA_CHAINED (after arena_reset)");
+
+    arena_reset_decommit(&a, 0);
+    printf("\nARENA_CHAINED (after arena_reset_decommit)\n");
+    printf("  blocks    : %lu\n", (unsigned long)a.block_count);
+    printf("  released  : %lu KiB\n", (unsigned long)(a.released / 1024));
+
+    arena_destroy(&a);
+}
+
+/*
+ Phases of small nodes plus one LARGE_BUFFER scratch buffer, reset
+ between phases. Without a threshold the buffer stays committed in the
+ arena after every reset; with one it is unmapped at phase end.
+*/
+static void bench_large_one(const char *name, size_t threshold)
+{
+    Arena a;
+    ArenaConfig cfg;
+    size_t i, j;
+    double t0, t1;
+
+    arena_config_init(&cfg, 1024UL * 1024 * 1024, 64UL * 1024);
+    cfg.large_threshold = threshold;
+
+    if (!arena_init_ex(&a, &cfg)) {
+        printf("arena_init_ex failed\n");
+        return;
+    }
+
+    t0 = now_seconds();
+
+    for (i = 0; i < LARGE_PHASES; ++i) {
+        unsigned char *buf;
+
+        for (j = 0; j < LARGE_NODES / 2; ++j)
+            arena_sink = arena_alloc(&a, BENCH_ALLOC_SIZE);
+
+        buf = (unsigned char *)arena_alloc(&a, LARGE_BUFFER);
+        if (!buf) {
+            printf("arena_alloc failed in phase %lu\n", (unsigned long)i);
+            break;
+        }
+        memset(buf, (int)i, LARGE_BUFFER);
+
+        for (j = 0; j < LARGE_NODES / 2; ++j)
+            arena_sink = arena_alloc(&a, BENCH_ALLOC_SIZE);
+
+        arena_reset(&a);
+    }
+
+    t1 = now_seconds();
+
+    printf("%s\n", name);
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  committed : %lu KiB after reset\n",
+           (unsigned long)((size_t)(a.commit - a.base) / 1024));
+    printf("  released  : %lu KiB\n", (unsigned long)(a.released / 1024));
+
+    arena_destroy(&a);
+}
+
+static void bench_large(void)
+{
+    printf("phases     : %d\n", LARGE_PHASES);
+    printf("per phase  : %lu x %d bytes + one %lu MiB buffer\n",
+           (unsigned long)LARGE_NODES, BENCH_ALLOC_SIZE,
+           (unsigned long)(LARGE_BUFFER / (1024 * 1024)));
+    printf("threshold  : %lu KiB\n\n",
+           (unsigned long)(LARGE_THRESHOLD / 1024));
+
+    bench_large_one("ARENA (no threshold)", 0);
+    printf("\n");
+    bench_large_one("ARENA (large_threshold)", LARGE_THRESHOLD);
+}
+
+/*
+ One big fill followed by many small phases, with a fixed commit step
+ and with the adaptive one. The big fill shows the syscall count; the
+ small phases show that the step starts small again after a reset.
+*/
+static void bench_commit_one(const char *name, size_t step_max)
+{
+    Arena a;
+    ArenaConfig cfg;
+    size_t i, j, fill_calls;
+    double t0, t1;
+
+    arena_config_init(&cfg, 1024UL * 1024 * 1024, 64UL * 1024);
+    cfg.commit_step_max = step_max;
+
+    if (!arena_init_ex(&a, &cfg)) {
+        printf("arena_init_ex failed\n");
+        return;
+    }
+
+    t0 = now_seconds();
+    for (i = 0; i < BENCH_ITERATIONS; ++i) {
+        arena_sink = arena_alloc(&a, BENCH_ALLOC_SIZE);
+        if (!arena_sink) {
+            printf("arena_alloc failed at %lu\n", (unsigned long)i);
+            break;
+        }
+    }
+    t1 = now_seconds();
+    fill_calls = a.commit_calls;
+
+    printf("%s\n", name);
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  alloc/sec : %.0f\n", BENCH_ITERATIONS / (t1 - t0));
+    printf("  commits   : %lu (fill)\n", (unsigned long)fill_calls);
+
+    /* Small phases: each decommits to 0 and commits again */
+    for (i = 0; i < COMMIT_SMALL_PHASES; ++i) {
+        arena_reset_decommit(&a, 0);
+        for (j = 0; j < COMMIT_SMALL_NODES; ++j)
+            arena_sink = arena_alloc(&a, BENCH_ALLOC_SIZE);
+    }
+
+    printf("  commits   : %lu (%d small phases)\n",
+           (unsigned long)(a.commit_calls - fill_calls),
+           COMMIT_SMALL_PHASES);
+    printf("  decommits : %lu\n", (unsigned long)a.decommit_calls);
+    printf("  committed : %lu KiB after a small phase\n",
+           (unsigned long)((size_t)(a.commit - a.base) / 1024));
+
+    arena_destroy(&a);
+}
+
+static void bench_commit(void)
+{
+    printf("alloc size : %d bytes\n", BENCH_ALLOC_SIZE);
+    printf("iterations : %lu\n\n", (unsigned long)BENCH_ITERATIONS);
+
+    bench_commit_one("ARENA (fixed 64 KiB step)", 64UL * 1024);
+    printf("\n");
+    bench_commit_one("ARENA (adaptive 64 KiB .. 4 MiB step)",
+                     ARENA_COMMIT_STEP_MAX);
+}
+
+/*
+ Fill an arena whose peak is known, writing each block, with lazy
+ faults and with `populate` set to the peak. The second pays the
+ faults inside arena_init_ex, in one madvise where available.
+*/
+static void bench_populate_one(const char *name, size_t populate)
+{
+    Arena a;
+    ArenaConfig cfg;
+    size_t i;
+    double t0, t1, t2;
+
+    arena_config_init(&cfg, 1024UL * 1024 * 1024, 64UL * 1024);
+    cfg.populate = populate;
+
+    t0 = now_seconds();
+    if (!arena_init_ex(&a, &cfg)) {
+        printf("arena_init_ex failed\n");
+        return;
+    }
+    t1 = now_seconds();
+
+    for (i = 0; i < BENCH_ITERATIONS; ++i) {
+        uint8_t *p = (uint8_t *)arena_alloc(&a, BENCH_ALLOC_SIZE);
+        if (!p) {
+            printf("arena_alloc failed at %lu\n", (unsigned long)i);
+            break;
+        }
+        p[0] = (uint8_t)i;
+    }
+    t2 = now_seconds();
+
+    printf("%s\n", name);
+    printf("  init      : %.3f sec\n", t1 - t0);
+    printf("  fill      : %.3f sec\n", t2 - t1);
+    printf("  alloc/sec : %.0f\n", BENCH_ITERATIONS / (t2 - t1));
+    printf("  commits   : %lu\n", (unsigned long)a.commit_calls);
+
+    arena_destroy(&a);
+}
+
+/*
+ arena_alloc_zeroed over a populated range: the pages are fresh, so no
+ byte should be memset. An overcommit reset must still purge them.
+*/
+static void bench_populate_zeroed(const char *name, unsigned flags)
+{
+    Arena a;
+    ArenaConfig cfg;
+    size_t i, zeroed = 0;
+    double t0, t1;
+
+    arena_config_init(&cfg, 1024UL * 1024 * 1024, 64UL * 1024);
+    cfg.populate = POPULATE_BYTES;
+    cfg.flags = flags;
+    if (!arena_init_ex(&a, &cfg)) {
+        printf("arena_init_ex failed\n");
+        return;
+    }
+
+    t0 = now_seconds();
+    for (i = 0; i < BENCH_ITERATIONS; ++i) {
+        uint8_t *dirty = a.touched;
+        uint8_t *p = (uint8_t *)arena_alloc_zeroed(&a, BENCH_ALLOC_SIZE);
+        if (!p) {
+            printf("arena_alloc_zeroed failed at %lu\n", (unsigned long)i);
+            break;
+        }
+        /* arena_alloc_zeroed memsets whatever lies below the dirty mark */
+        if (p < dirty)
+            zeroed += (size_t)(dirty - p) < BENCH_ALLOC_SIZE
+                    ? (size_t)(dirty - p) : BENCH_ALLOC_SIZE;
+    }
+    t1 = now_seconds();
+
+    arena_reset_decommit(&a, 0);
+
+    printf("%s\n", name);
+    printf("  fill      : %.3f sec\n", t1 - t0);
+    printf("  memset    : %lu bytes\n", (unsigned long)zeroed);
+    printf("  released  : %lu MiB on reset\n",
+           (unsigned long)(a.released / (1024 * 1024)));
+
+    arena_destroy(&a);
+}
+
+static void bench_populate(void)
+{
+    printf("alloc size : %d bytes (first byte written)\n", BENCH_ALLOC_SIZE);
+    printf("iterations : %lu\n\n", (unsigned long)BENCH_ITERATIONS);
+
+    bench_populate_one("ARENA (lazy faults)", 0);
+    printf("\n");
+    bench_populate_one("ARENA (populate at init)", POPULATE_BYTES);
+    printf("\n");
+    bench_populate_zeroed("ARENA (populate, arena_alloc_zeroed)", 0);
+    printf("\n");
+    bench_populate_zeroed("ARENA (populate, overcommit, arena_alloc_zeroed)",
+                          ARENA_OVERCOMMIT);
+}
+
+/*
+ Fault in NUMA_BYTES under each policy and report where the first page
+ landed. On a single-node machine every mode falls back to the
+ default and the numbers should match.
+*/
+static void bench_numa_one(const char *name, int mode, int node)
+{
+    Arena a;
+    ArenaConfig cfg;
+    size_t i;
+    double t0, t1;
+
+    arena_config_init(&cfg, 1024UL * 1024 * 1024, 64UL * 1024);
+    cfg.numa_mode = mode;
+    cfg.numa_node = node;
+
+    if (!arena_init_ex(&a, &cfg)) {
+        printf("%s\n  arena_init_ex failed (no such node?)\n", name);
+        return;
+    }
+
+    t0 = now_seconds();
+    for (i = 0; i < NUMA_BYTES / BENCH_ALLOC_SIZE; ++i) {
+        uint8_t *p = (uint8_t *)arena_alloc(&a, BENCH_ALLOC_SIZE);
+        if (!p) {
+            printf("arena_alloc failed at %lu\n", (unsigned long)i);
+            break;
+        }
+        p[0] = (uint8_t)i;
+    }
+    t1 = now_seconds();
+
+    printf("%s\n", name);
+    printf("  policy    : %s\n",
+           a.numa_mode == ARENA_NUMA_BIND ? "bind"
+           : a.numa_mode == ARENA_NUMA_PREFERRED ? "preferred"
+           : a.numa_mode == ARENA_NUMA_INTERLEAVE ? "interleave"
+           : "default (first touch)");
+    printf("  node      : %d\n", arena_numa_node(&a));
+    printf("  fill      : %.3f sec\n", t1 - t0);
+
+    arena_destroy(&a);
+}
+
+static void bench_numa(void)
+{
+    unsigned long nodes[OS_NUMA_WORDS];
+
+    printf("nodes      : %d\n", os_numa_nodes(nodes));
+    printf("fill size  : %lu MiB\n\n",
+           (unsigned long)(NUMA_BYTES / (1024 * 1024)));
+
+    bench_numa_one("ARENA (default)", ARENA_NUMA_DEFAULT, 0);
+    printf("\n");
+    bench_numa_one("ARENA (bind node 0)", ARENA_NUMA_BIND, 0);
+    printf("\n");
+    bench_numa_one("ARENA (bind node 1)", ARENA_NUMA_BIND, 1);
+    printf("\n");
+    bench_numa_one("ARENA (preferred node 1)", ARENA_NUMA_PREFERRED, 1);
+    printf("\n");
+    bench_numa_one("ARENA (interleave)", ARENA_NUMA_INTERLEAVE, 0);
+}
+
+/*
+ ArenaPool against malloc/free at BENCH_ALLOC_SIZE. "pairs" is
+ bench_malloc's loop (allocate, free at once); "churn" keeps POOL_LIVE
+ objects alive and replaces a pseudo-random one per iteration.
+*/
+static void bench_pool_report(const char *name, double t0, double t1)
+{
+    printf("%s\n", name);
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  alloc/sec : %.0f\n", BENCH_ITERATIONS / (t1 - t0));
+}
+
+static void bench_pool(void)
+{
+    static void *live[POOL_LIVE];
+    Arena a;
+    ArenaPool pool;
+    size_t i, idx;
+    double t0, t1;
+
+    printf("alloc size : %d bytes\n", BENCH_ALLOC_SIZE);
+    printf("iterations : %lu\n", (unsigned long)BENCH_ITERATIONS);
+    printf("live (churn): %d\n\n", POOL_LIVE);
+
+    if (!arena_init(&a, 1024UL * 1024 * 1024, 64UL * 1024) ||
+        !arena_pool_init(&pool, &a, BENCH_ALLOC_SIZE, 0)) {
+        printf("arena_init failed\n");
+        return;
+    }
+
+    /* allocate + free at once */
+    t0 = now_seconds();
+    for (i = 0; i < BENCH_ITERATIONS; ++i) {
+        void *p = arena_pool_alloc(&pool);
+        if (!p)
+            break;
+        arena_sink = p;
+        arena_pool_free(&pool, p);
+    }
+    t1 = now_seconds();
+    bench_pool_report("ARENA POOL (pairs)", t0, t1);
+    printf("\n");
+
+    t0 = now_seconds();
+    for (i = 0; i < BENCH_ITERATIONS; ++i) {
+        void *p = malloc(BENCH_ALLOC_SIZE);
+        if (!p)
+            break;
+        malloc_sink = p;
+        free(p);
+    }
+    t1 = now_seconds();
+    bench_pool_report("MALLOC/FREE (pairs)", t0, t1);
+    printf("\n");
+
+    /* churn: replace one of POOL_LIVE live objects per iteration */
+    arena_pool_reset(&pool);
+    for (i = 0; i < POOL_LIVE; ++i)
+        live[i] = arena_pool_alloc(&pool);
+
+    t0 = now_seconds();
+    idx = 1;
+    for (i = 0; i < BENCH_ITERATIONS; ++i) {
+        idx = (idx * 1103515245UL + 12345UL) % POOL_LIVE;
+        arena_pool_free(&pool, live[idx]);
+        live[idx] = arena_pool_alloc(&pool);
+        ((uint8_t *)live[idx])[0] = (uint8_t)i;
+    }
+    t1 = now_seconds();
+    bench_pool_report("ARENA POOL (churn)", t0, t1);
+    printf("  slots     : %lu carved, %lu live\n",
+           (unsigned long)pool.carved, (unsigned long)pool.live);
+    printf("\n");
+
+    for (i = 0; i < POOL_LIVE; ++i)
+        live[i] = malloc(BENCH_ALLOC_SIZE);
+
+    t0 = now_seconds();
+    idx = 1;
+    for (i = 0; i < BENCH_ITERATIONS; ++i) {
+        idx = (idx * 1103515245UL + 12345UL) % POOL_LIVE;
+        free(live[idx]);
+        live[idx] = malloc(BENCH_ALLOC_SIZE);
+        if (!live[idx])
+            break;
+        ((uint8_t *)live[idx])[0] = (uint8_t)i;
+    }
+    t1 = now_seconds();
+    bench_pool_report("MALLOC/FREE (churn)", t0, t1);
+
+    for (i = 0; i < POOL_LIVE; ++i)
+        free(live[i]);
+
+    arena_pool_reset(&pool);
+    arena_destroy(&a);
+}
+
+/*
+ Mixed-size churn: SLAB_LIVE objects stay alive and each iteration
+ frees a pseudo-random one and allocates a replacement. Sizes are
+ geometric over the classes (half fit 16 B, a quarter 32 B, ...) and
+ uniform within a class, so small objects dominate as in most
+ allocation-heavy code. Both runs draw the same sequence.
+*/
+static size_t slab_next_size(size_t *rng)
+{
+    size_t r, k = 0;
+
+    *rng = *rng * 1103515245UL + 12345UL;
+    r = *rng >> 8;
+    while (k < ARENA_SLAB_CLASSES - 1 && (r & ((size_t)1 << k)))
+        ++k;
+    return 1 + (r >> 12) % ((size_t)ARENA_SLAB_MIN << k);
+}
+
+static void bench_slab(void)
+{
+    static void *live[SLAB_LIVE];
+    static size_t live_size[SLAB_LIVE];
+    Arena a;
+    ArenaSlab slab;
+    size_t i, idx, rng;
+    unsigned c;
+    double t0, t1;
+
+    printf("sizes      : 1..%d bytes, mostly small\n", ARENA_SLAB_MAX);
+    printf("iterations : %lu\n", (unsigned long)BENCH_ITERATIONS);
+    printf("live       : %d\n\n", SLAB_LIVE);
+
+    if (!arena_init(&a, 1024UL * 1024 * 1024, 64UL * 1024)) {
+        printf("arena_init failed\n");
+        return;
+    }
+    arena_slab_init(&slab, &a);
+
+    rng = 1;
+    for (i = 0; i < SLAB_LIVE; ++i) {
+        live_size[i] = slab_next_size(&rng);
+        live[i] = arena_slab_alloc(&slab, live_size[i]);
+    }
+
+    t0 = now_seconds();
+    idx = 1;
+    for (i = 0; i < BENCH_ITERATIONS; ++i) {
+        idx = (idx * 1103515245UL + 12345UL) % SLAB_LIVE;
+        arena_slab_free(&slab, live[idx], live_size[idx]);
+        live_size[idx] = slab_next_size(&rng);
+        live[idx] = arena_slab_alloc(&slab, live_size[idx]);
+        if (!live[idx])
+            break;
+        ((uint8_t *)live[idx])[0] = (uint8_t)i;
+    }
+    t1 = now_seconds();
+
+    printf("ARENA SLAB\n");
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  alloc/sec : %.0f\n", BENCH_ITERATIONS / (t1 - t0));
+    printf("  arena used: %lu KiB for %lu KiB live\n",
+           (unsigned long)(arena_used(&a) / 1024),
+           (unsigned long)(arena_slab_live_bytes(&slab) / 1024));
+    printf("  class      live      peak   slabs   occupancy\n");
+    for (c = 0; c < ARENA_SLAB_CLASSES; ++c) {
+        const ArenaSlabClass *k = &slab.classes[c];
+        size_t carved = k->slabs * (ARENA_SLAB_BYTES / k->slot_size);
+
+        printf("  %5lu  %8lu  %8lu  %6lu   %8.1f%%\n",
+               (unsigned long)k->slot_size, (unsigned long)k->live,
+               (unsigned long)k->peak, (unsigned long)k->slabs,
+               carved ? 100.0 * (double)k->live / (double)carved : 0.0);
+    }
+    printf("\n");
+
+    rng = 1;
+    for (i = 0; i < SLAB_LIVE; ++i) {
+        live_size[i] = slab_next_size(&rng);
+        live[i] = malloc(live_size[i]);
+    }
+
+    t0 = now_seconds();
+    idx = 1;
+    for (i = 0; i < BENCH_ITERATIONS; ++i) {
+        idx = (idx * 1103515245UL + 12345UL) % SLAB_LIVE;
+        free(live[idx]);
+        live_size[idx] = slab_next_size(&rng);
+        live[idx] = malloc(live_size[idx]);
+        if (!live[idx])
+            break;
+        ((uint8_t *)live[idx])[0] = (uint8_t)i;
+    }
+    t1 = now_seconds();
+
+    printf("MALLOC/FREE\n");
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  alloc/sec : %.0f\n", BENCH_ITERATIONS / (t1 - t0));
+    printf("\n");
+
+    /* end of phase: one reset against SLAB_LIVE frees */
+    t0 = now_seconds();
+    arena_slab_reset(&slab);
+    t1 = now_seconds();
+    printf("phase end  : arena_slab_reset %.1f us,", (t1 - t0) * 1e6);
+
+    t0 = now_seconds();
+    for (i = 0; i < SLAB_LIVE; ++i)
+        free(live[i]);
+    t1 = now_seconds();
+    printf(" %d x free %.1f us\n", SLAB_LIVE, (t1 - t0) * 1e6);
+
+    arena_destroy(&a);
+}
+
+/*
+ Worst-case latency: TLSF_LIVE blocks of 16 B to 64 KiB (mostly
+ small) stay alive while each operation frees one and allocates a
+ replacement of a new size; the pair is timed together, including the
+ first write. Pass 1 starts cold (the heap grows, pages fault in),
+ pass 2 is the steady state a tick loop lives in.
+*/
+typedef struct TlsfLatency {
+    unsigned long count[TLSF_BUCKETS];  /* [2^i, 2^(i+1)) ns */
+    double max;
+    double total;
+} TlsfLatency;
+
+static void tlsf_latency_record(TlsfLatency *h, double ns)
+{
+    unsigned long v = ns < 1.0 ? 1UL : (unsigned long)ns;
+    int b = 0;
+
+    while (v > 1 && b < TLSF_BUCKETS - 1) {
+        v >>= 1;
+        ++b;
+    }
+    ++h->count[b];
+    h->total += ns;
+    if (ns > h->max)
+        h->max = ns;
+}
+
+/* Upper bound of the bucket holding quantile q */
+static unsigned long tlsf_latency_quantile(const TlsfLatency *h, double q)
+{
+    unsigned long want = (unsigned long)((double)TLSF_OPS * q);
+    unsigned long seen = 0;
+    int b;
+
+    for (b = 0; b < TLSF_BUCKETS; ++b) {
+        seen += h->count[b];
+        if (seen > want)
+            return 2UL << b;
+    }
+    return 2UL << (TLSF_BUCKETS - 1);
+}
+
+static size_t tlsf_next_size(size_t *rng)
+{
+    size_t r, k = 0;
+
+    *rng = *rng * 1103515245UL + 12345UL;
+    r = *rng >> 8;
+    while (k < 12 && (r & ((size_t)1 << k)))
+        ++k;
+    return 1 + (r >> 13) % ((size_t)16 << k);
+}
+
+static void bench_tlsf_pass(const char *name, ArenaTlsf *t, void **live,
+                            size_t *rng)
+{
+    static TlsfLatency h;
+    size_t i, idx = 1;
+
+    memset(&h, 0, sizeof(h));
+
+    for (i = 0; i < TLSF_OPS; ++i) {
+        size_t size = tlsf_next_size(rng);
+        double t0, t1;
+
+        idx = (idx * 1103515245UL + 12345UL) % TLSF_LIVE;
+
+        t0 = now_seconds();
+        if (t) {
+            arena_tlsf_free(t, live[idx]);
+            live[idx] = arena_tlsf_alloc(t, size);
+        } else {
+            free(live[idx]);
+            live[idx] = malloc(size);
+        }
+        if (!live[idx]) {
+            printf("alloc failed at %lu\n", (unsigned long)i);
+            return;
+        }
+        ((uint8_t *)live[idx])[0] = (uint8_t)i;
+        t1 = now_seconds();
+
+        tlsf_latency_record(&h, (t1 - t0) * 1e9);
+    }
+
+    printf("%s\n", name);
+    printf("  mean %.0f ns, p99 < %lu ns, p99.9 < %lu ns,"
+           " p99.99 < %lu ns, worst %.0f ns\n",
+           h.total / (double)TLSF_OPS,
+           tlsf_latency_quantile(&h, 0.99),
+           tlsf_latency_quantile(&h, 0.999),
+           tlsf_latency_quantile(&h, 0.9999), h.max);
+}
+
+static void bench_tlsf(void)
+{
+    static void *live[TLSF_LIVE];
+    Arena a;
+    ArenaTlsf t;
+    size_t rng;
+
+    printf("sizes      : 1..64 KiB, mostly small\n");
+    printf("live       : %d\n", TLSF_LIVE);
+    printf("ops / pass : %lu (free + alloc + first write)\n\n",
+           (unsigned long)TLSF_OPS);
+
+    if (!arena_init(&a, 4096UL * 1024 * 1024, 64UL * 1024)) {
+        printf("arena_init failed\n");
+        return;
+    }
+    arena_tlsf_init(&t, &a);
+
+    memset(live, 0, sizeof(live));
+    rng = 1;
+    bench_tlsf_pass("ARENA TLSF (cold: heap grows)", &t, live, &rng);
+    bench_tlsf_pass("ARENA TLSF (steady)", &t, live, &rng);
+    printf("  heap      : %lu KiB in %lu grows, %lu KiB used,"
+           " peak %lu KiB\n\n",
+           (unsigned long)(t.pooled / 1024), (unsigned long)t.grows,
+           (unsigned long)(t.used / 1024), (unsigned long)(t.peak / 1024));
+
+    memset(live, 0, sizeof(live));
+    rng = 1;
+    bench_tlsf_pass("MALLOC/FREE (cold)", NULL, live, &rng);
+    bench_tlsf_pass("MALLOC/FREE (steady)", NULL, live, &rng);
+
+    {
+        size_t i;
+
+        for (i = 0; i < TLSF_LIVE; ++i)
+            free(live[i]);
+    }
+
+    arena_tlsf_reset(&t);
+    arena_destroy(&a);
+}
+
+/*
+ Buffers of 1 B to 512 KiB, geometric over the powers of two (half up
+ to 4 KiB, a quarter up to 8 KiB, ...) and uniform within one, so
+ most requests are not powers of two and internal fragmentation shows.
+*/
+static size_t buddy_next_size(size_t *rng)
+{
+    size_t r, k = 0;
+
+    *rng = *rng * 1103515245UL + 12345UL;
+    r = *rng >> 8;
+    while (k < 7 && (r & ((size_t)1 << k)))
+        ++k;
+    return 1 + (r >> 11) % (BUDDY_MIN << k);
+}
+
+/*
+ Churn BUDDY_LIVE buffers through BUDDY_OPS free/alloc replacements,
+ then report throughput and fragmentation: internal (rounding to a
+ power of two) and external (free blocks below the top level, spread
+ over the top-level blocks that are in use). Freeing everything at the
+ end shows top-level blocks going back to the OS beyond BUDDY_RETAIN.
+*/
+static void bench_buddy(void)
+{
+    static void *live[BUDDY_LIVE];
+    static size_t live_size[BUDDY_LIVE];
+    Arena a;
+    ArenaBuddy b;
+    size_t i, idx, rng, requested, split_free, top_free;
+    const ArenaBuddyNode *n;
+    unsigned o;
+    double t0, t1;
+
+    printf("blocks     : %lu KiB .. %lu KiB, %d top-level (retain %d)\n",
+           BUDDY_MIN / 1024, BUDDY_MAX / 1024, BUDDY_COUNT, BUDDY_RETAIN);
+    printf("requests   : 1 B .. 512 KiB, mostly small\n");
+    printf("live       : %d\n", BUDDY_LIVE);
+    printf("ops        : %lu\n\n", (unsigned long)BUDDY_OPS);
+
+    if (!arena_init(&a, 1024UL * 1024 * 1024, 64UL * 1024) ||
+        !arena_buddy_init(&b, &a, BUDDY_MIN, BUDDY_MAX,
+                          BUDDY_COUNT, BUDDY_RETAIN)) {
+        printf("arena_buddy_init failed\n");
+        return;
+    }
+
+    rng = 1;
+    requested = 0;
+    for (i = 0; i < BUDDY_LIVE; ++i) {
+        live_size[i] = buddy_next_size(&rng);
+        live[i] = arena_buddy_alloc(&b, live_size[i]);
+        requested += live_size[i];
+    }
+
+    t0 = now_seconds();
+    idx = 1;
+    for (i = 0; i < BUDDY_OPS; ++i) {
+        idx = (idx * 1103515245UL + 12345UL) % BUDDY_LIVE;
+        arena_buddy_free(&b, live[idx], live_size[idx]);
+        requested -= live_size[idx];
+        live_size[idx] = buddy_next_size(&rng);
+        live[idx] = arena_buddy_alloc(&b, live_size[idx]);
+        if (!live[idx]) {
+            printf("alloc failed at %lu\n", (unsigned long)i);
+            break;
+        }
+        requested += live_size[idx];
+        ((uint8_t *)live[idx])[0] = (uint8_t)i;
+    }
+    t1 = now_seconds();
+
+    split_free = 0;
+    for (o = b.min_order; o < b.max_order; ++o) {
+        for (n = b.free[o].next; n != &b.free[o]; n = n->next)
+            split_free += (size_t)1 << o;
+    }
+    top_free = b.returned;
+    for (n = b.free[b.max_order].next; n != &b.free[b.max_order];
+         n = n->next)
+        ++top_free;
+
+    printf("ARENA BUDDY\n");
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  alloc/sec : %.0f\n", BUDDY_OPS / (t1 - t0));
+    printf("  live      : %lu KiB requested, %lu KiB in blocks"
+           " (peak %lu KiB)\n",
+           (unsigned long)(requested / 1024), (unsigned long)(b.used / 1024),
+           (unsigned long)(b.peak / 1024));
+    printf("  internal  : %.1f%% of block bytes unused\n",
+           100.0 * (double)(b.used - requested) / (double)b.used);
+    printf("  external  : %lu KiB free in split blocks, %.1f%% of the"
+           " %lu top-level blocks in use\n",
+           (unsigned long)(split_free / 1024),
+           100.0 * (double)split_free
+                 / (double)((BUDDY_COUNT - top_free) * BUDDY_MAX),
+           (unsigned long)(BUDDY_COUNT - top_free));
+    printf("  largest   : %lu KiB free block\n",
+           (unsigned long)(arena_buddy_largest_free(&b) / 1024));
+    printf("  splits    : %lu, merges %lu\n",
+           (unsigned long)b.splits, (unsigned long)b.merges);
+
+    for (i = 0; i < BUDDY_LIVE; ++i)
+        arena_buddy_free(&b, live[i], live_size[i]);
+    printf("  all freed : %lu of %d top-level blocks resident,"
+           " %lu without pages\n",
+           (unsigned long)b.resident, BUDDY_COUNT,
+           (unsigned long)b.returned);
+    printf("  purges    : %lu madvise calls since init\n\n",
+           (unsigned long)b.purges);
+
+    rng = 1;
+    for (i = 0; i < BUDDY_LIVE; ++i) {
+        live_size[i] = buddy_next_size(&rng);
+        live[i] = malloc(live_size[i]);
+    }
+
+    t0 = now_seconds();
+    idx = 1;
+    for (i = 0; i < BUDDY_OPS; ++i) {
+        idx = (idx * 1103515245UL + 12345UL) % BUDDY_LIVE;
+        free(live[idx]);
+        live_size[idx] = buddy_next_size(&rng);
+        live[idx] = malloc(live_size[idx]);
+        if (!live[idx])
+            break;
+        ((uint8_t *)live[idx])[0] = (uint8_t)i;
+    }
+    t1 = now_seconds();
+
+    printf("MALLOC/FREE\n");
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  alloc/sec : %.0f\n", BUDDY_OPS / (t1 - t0));
+
+    for (i = 0; i < BUDDY_LIVE; ++i)
+        free(live[i]);
+
+    arena_destroy(&a);
+}
+
+/*
+ Per-request arenas: arena_init/arena_destroy around every request vs
+ acquire/release from an ArenaCache. Requests are handled one at a
+ time, so after warm-up every acquire is a hit.
+*/
+static void bench_cache(void)
+{
+    ArenaCache c;
+    ArenaConfig cfg;
+    size_t i, j;
+    double t0, t1;
+
+    printf("requests   : %lu\n", (unsigned long)CACHE_REQUESTS);
+    printf("per request: %lu x %d bytes\n",
+           (unsigned long)CACHE_NODES, BENCH_ALLOC_SIZE);
+    printf("retain     : %lu KiB\n\n",
+           (unsigned long)(CACHE_RETAIN / 1024));
+
+    arena_config_init(&cfg, 64UL * 1024 * 1024, 64UL * 1024);
+
+    t0 = now_seconds();
+
+    for (i = 0; i < CACHE_REQUESTS; ++i) {
+        Arena a;
+
+        if (!arena_init_ex(&a, &cfg)) {
+            printf("arena_init_ex failed\n");
+            return;
+        }
+        for (j = 0; j < CACHE_NODES; ++j)
+            arena_sink = arena_alloc(&a, BENCH_ALLOC_SIZE);
+        arena_destroy(&a);
+    }
+
+    t1 = now_seconds();
+
+    printf("ARENA (arena_init / arena_destroy)\n");
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  req/sec   : %.0f\n", CACHE_REQUESTS / (t1 - t0));
+    printf("\n");
+
+    if (!arena_cache_init(&c, &cfg, CACHE_ARENAS / 2, CACHE_ARENAS,
+                          CACHE_RETAIN)) {
+        printf("arena_cache_init failed\n");
+        return;
+    }
+
+    t0 = now_seconds();
+
+    for (i = 0; i < CACHE_REQUESTS; ++i) {
+        Arena *a = arena_cache_acquire(&c);
+
+        if (!a) {
+            printf("arena_cache_acquire failed\n");
+            break;
+        }
+        for (j = 0; j < CACHE_NODES; ++j)
+            arena_sink = arena_alloc(a, BENCH_ALLOC_SIZE);
+        arena_cache_release(&c, a);
+    }
+
+    t1 = now_seconds();
+
+    printf("ARENA (ArenaCache acquire / release)\n");
+    printf("  time      : %.3f sec\n", t1 - t0);
+    printf("  req/sec   : %.0f\n", CACHE_REQUESTS / (t1 - t0));
+    printf("  hit rate  : %.2f%%\n",
+           100.0 * (double)c.hits / (double)c.acquires);
+    printf("  pooled    : %lu KiB committed in %lu idle arenas\n",
+           (unsigned long)(arena_cache_pooled_bytes(&c) / 1024),
+           (unsigned long)c.idle_count);
+
+    arena_cache_destroy(&c);
+}
+
+/* =========================================================
  * main
  * ========================================================= */
-#ifndef GIGA_ARENA_NO_MAIN
-int main(void)
+
+typedef struct BenchMode {
+    const char *name;
+    void (*run)(void);
+    const char *help;
+} BenchMode;
+
+static const BenchMode bench_modes[] = {
+    { "alloc", bench_alloc, "arena_alloc vs malloc/free (default)" },
+    { "walk",  bench_walk,  "random reads, 4 KiB vs huge pages" },
+    { "hugetlb", bench_hugetlb, "hugetlb pool backend and fallback" },
+    { "overcommit", bench_overcommit, "os_commit vs ARENA_OVERCOMMIT" },
+    { "scope", bench_scope, "arena_mark/arena_rewind vs init/destroy" },
+    { "scratch", bench_scratch, "scratch arenas vs malloc temporaries" },
+    { "align", bench_align, "per-arena alignment, arena_alloc_aligned" },
+    { "resize", bench_resize, "arena_resize in place vs copy" },
+    { "zeroed", bench_zeroed, "arena_alloc_zeroed vs memset" },
+    { "many", bench_many, "arena_alloc_many vs one call per node" },
+    { "chain", bench_chain, "ARENA_CHAINED growth, reuse and trim" },
+    { "large", bench_large, "large_threshold bypass vs in-arena buffer" },
+    { "cache", bench_cache, "ArenaCache vs arena_init per request" },
+    { "commit", bench_commit, "fixed vs adaptive commit_step" },
+    { "populate", bench_populate, "pre-faulted arena vs lazy faults" },
+    { "numa", bench_numa, "NUMA bind / preferred / interleave" },
+    { "pool", bench_pool, "ArenaPool fixed-size slots vs malloc/free" },
+    { "slab", bench_slab, "ArenaSlab size classes vs malloc/free" },
+    { "tlsf", bench_tlsf, "ArenaTlsf worst-case latency vs malloc/free" },
+    { "buddy", bench_buddy, "ArenaBuddy fragmentation and throughput" }
+};
+
+#define BENCH_MODE_COUNT (sizeof(bench_modes) / sizeof(bench_modes[0]))
+
+int main(int argc, char **argv)
 {
+    const char *mode = argc > 1 ? argv[1] : "alloc";
+    size_t i;
+
     printf("============================================\n");
     printf(" OS-Native Arena Allocator Benchmark (C89)\n");
     printf("============================================\n");
-    printf("alloc size : %d bytes\n", BENCH_ALLOC_SIZE);
-    printf("iterations : %lu\n\n",
-           (unsigned long)BENCH_ITERATIONS);
 
-    bench_arena();
-    printf("\n");
-    bench_malloc();
+    for (i = 0; i < BENCH_MODE_COUNT; ++i) {
+        if (strcmp(mode, bench_modes[i].name) == 0) {
+            bench_modes[i].run();
+            return 0;
+        }
+    }
 
-    return 0;
+    printf("unknown mode: %s\n\nmodes:\n", mode);
+    for (i = 0; i < BENCH_MODE_COUNT; ++i)
+        printf("  %-10s %s\n", bench_modes[i].name, bench_modes[i].help);
+
+    return 1;
 }
 #endif